@@ -7,6 +7,7 @@
 #include "GraphicsCore/Pipeline.h"
 #include "GraphicsCore/Shader.h"
 #include "GraphicsCore/Synchronization.h"
+#include "RenderGraph/RenderGraph.h"
 
 std::shared_ptr<Buffer> CreateStorageBuffer(Allocator& allocator, uint32_t num_elements) {
     return allocator.AllocateBuffer({
@@ -19,7 +20,8 @@ std::shared_ptr<Buffer> CreateStorageBuffer(Allocator& allocator, uint32_t num_e
 }
 
 int main() {
-    Context context{ "Vulkan Rendergraph", 1600, 900 };
+    // Nothing is presented, so this runs without a window (and without a display).
+    Context context{ "Vulkan Rendergraph" };
     Allocator allocator{context.GetInstance(), context.GetDevice()};
     DescriptorPool descriptor_pool{context.GetDevice()};
 
@@ -49,13 +51,6 @@ int main() {
 
     Fence compute_fence{ context.GetDevice(), false };
 
-    /*
-    auto parameters = graph.AllocParameters<HelloWorldComputeParameters>();
-    parameters->buffer1 = graph.ImportExternalBuffer(buffer1);
-    parameters->buffer2 = graph.ImportExternalBuffer(buffer2);
-    parameters->output = graph.ImportExternalBuffer(output);
-    */
-
     std::shared_ptr<DescriptorSetLayout> compute_layout = compute_shader->GetParameterLayouts().at(0);
     std::shared_ptr<DescriptorSet> descriptor_set = descriptor_pool.AllocateDescriptorSet(compute_layout);
 
@@ -64,24 +59,30 @@ int main() {
     descriptor_set->WriteBufferDescriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, output, 0, num_elements * sizeof(float));
     descriptor_set->Update();
 
-    /*
-    graph.AddPass("HelloWorldCompute", parameters, [parameters, hello_world_compute](CommandBuffer command_buffer){
-        SetParameters(command_buffer, parameters); // this should handle writing descriptor sets
-        hello_world_compute.DispatchCompute(command_buffer, num_elements, 1, 1);
-    });
-
+    RenderGraph graph{context.GetDevice(), allocator};
+    RenderGraph::BufferHandle buffer1_handle = graph.ImportBuffer(buffer1);
+    RenderGraph::BufferHandle buffer2_handle = graph.ImportBuffer(buffer2);
+    RenderGraph::BufferHandle output_handle = graph.ImportBuffer(output);
+
+    graph.AddPass("HelloWorldCompute", RenderGraph::PassType::COMPUTE, [&](CommandBuffer& command_buffer) {
+        compute_pipeline.Bind(command_buffer);
+        compute_pipeline.BindDescriptorSet(command_buffer, 0, descriptor_set);
+        compute_pipeline.DispatchCompute(command_buffer, num_elements, 1, 1);
+    })
+        .Read(buffer1_handle, RenderGraph::Usage::STORAGE_BUFFER)
+        .Read(buffer2_handle, RenderGraph::Usage::STORAGE_BUFFER)
+        .Write(output_handle, RenderGraph::Usage::STORAGE_BUFFER);
+
+    // The output is read back on the CPU once the graph has finished.
+    graph.ExportBuffer(output_handle, RenderGraph::Usage::HOST);
     graph.Compile();
-    graph.Execute();
-    */
 
     main_command.Begin(true);
-    compute_pipeline.Bind(main_command);
-    compute_pipeline.BindDescriptorSet(main_command, 0, descriptor_set);
-    compute_pipeline.DispatchCompute(main_command, num_elements, 1, 1);
+    graph.Execute(main_command);
     main_command.End();
 
     main_command.Submit(&compute_fence);
-    compute_fence.Wait(100000);
+    compute_fence.Wait(UINT64_MAX);
 
     float* output_data = reinterpret_cast<float*>(output->MapToCPU());
 
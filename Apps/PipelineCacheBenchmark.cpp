@@ -0,0 +1,80 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GraphicsCore/Context.h"
+#include "GraphicsCore/Pipeline.h"
+#include "GraphicsCore/PipelineCache.h"
+#include "GraphicsCore/Shader.h"
+
+// Creates the same set of pipelines once with no pipeline cache on disk, and once more in a new context that
+// loads the cache the first one saved, and reports the time spent creating pipelines in both.
+// Drivers may keep caches of their own (e.g. Mesa's shader cache), which make the cold run faster than a real
+// first launch, so those are best disabled for meaningful numbers.
+// Usage: PipelineCacheBenchmark [repetitions]
+static double CreatePipelines(uint32_t num_repetitions) {
+    Context context{ "Pipeline Cache Benchmark", false };
+
+    // Shaders come from the shader disk cache, so this mostly measures pipeline creation.
+    ShaderCompiler compiler{ context.GetDevice() };
+    std::vector<std::shared_ptr<Shader>> graphics_shaders = compiler.LoadProgram("HelloWorldGraphics", {"vertex_main", "fragment_main"});
+    std::shared_ptr<Shader> compute_shader = compiler.LoadShader("HelloWorldCompute", "compute_main");
+
+    // Different attachment formats make different pipelines out of the same shaders.
+    std::vector<VkFormat> color_formats = {
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_FORMAT_B8G8R8A8_UNORM,
+        VK_FORMAT_B8G8R8A8_SRGB,
+        VK_FORMAT_R16G16B16A16_SFLOAT,
+        VK_FORMAT_R32G32B32A32_SFLOAT,
+    };
+    std::vector<VkFormat> depth_formats = {
+        VK_FORMAT_UNDEFINED,
+        VK_FORMAT_D32_SFLOAT,
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t repetition = 0; repetition < num_repetitions; repetition++) {
+        for (VkFormat color_format : color_formats) {
+            for (VkFormat depth_format : depth_formats) {
+                GraphicsPipeline graphics_pipeline{ context.GetDevice(),
+                    {
+                        .vertex_shader = graphics_shaders[0],
+                        .fragment_shader = graphics_shaders[1],
+                    },
+                    {
+                        .color_formats = {color_format},
+                        .depth_format = depth_format,
+                    }
+                };
+            }
+        }
+
+        ComputePipeline compute_pipeline{ context.GetDevice(), compute_shader };
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    uint32_t num_repetitions = (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1])) : 1;
+
+    std::filesystem::path cache_path = PipelineCache::GetDefaultPath();
+    std::error_code error;
+    std::filesystem::remove(cache_path, error);
+
+    // The context saves its cache when it is destroyed, which is what the warm run loads.
+    double cold_ms = CreatePipelines(num_repetitions);
+    uintmax_t cache_size = std::filesystem::file_size(cache_path, error);
+    double warm_ms = CreatePipelines(num_repetitions);
+
+    std::cout << "Pipeline cache: " << cache_path.string() << " (" << (error ? 0 : cache_size) << " bytes)" << std::endl;
+    std::cout << "Cold: " << cold_ms << " ms" << std::endl;
+    std::cout << "Warm: " << warm_ms << " ms" << std::endl;
+    std::cout << "Speedup: " << cold_ms / warm_ms << "x" << std::endl;
+}
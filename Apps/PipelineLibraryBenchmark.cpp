@@ -0,0 +1,90 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "GraphicsCore/Context.h"
+#include "GraphicsCore/Pipeline.h"
+#include "GraphicsCore/PipelineStateCache.h"
+#include "GraphicsCore/Shader.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double GetMilliseconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Measures how long the first use of a new variant of a material stalls: creating each variant as a whole pipeline,
+// against linking it from graphics pipeline libraries whose shader parts were compiled for another variant before.
+// The variants only differ in attachment formats and blending, like permutations of the same material usually do.
+// The pipeline cache on disk makes repeated runs faster for both, so the first run is the most meaningful.
+int main() {
+    Context context{ "Pipeline Library Benchmark", false };
+    std::shared_ptr<Device> device = context.GetDevice();
+
+    ShaderCompiler compiler{ device };
+    std::vector<std::shared_ptr<Shader>> graphics_shaders = compiler.LoadProgram("HelloWorldGraphics", {"vertex_main", "fragment_main"});
+    GraphicsPipeline::ShaderStages shaders = {
+        .vertex_shader = graphics_shaders[0],
+        .fragment_shader = graphics_shaders[1],
+    };
+
+    std::vector<VkFormat> color_formats = {
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_SRGB,
+        VK_FORMAT_B8G8R8A8_UNORM,
+        VK_FORMAT_B8G8R8A8_SRGB,
+        VK_FORMAT_R16G16B16A16_SFLOAT,
+        VK_FORMAT_R32G32B32A32_SFLOAT,
+    };
+
+    std::vector<PipelineStateCache::GraphicsDesc> variants;
+    for (VkBool32 blend_enable : {VK_FALSE, VK_TRUE}) {
+        for (VkFormat color_format : color_formats) {
+            variants.push_back({
+                .shaders = shaders,
+                .attachment_formats = {.color_formats = {color_format}},
+                .state = {.blend_enable = blend_enable},
+            });
+        }
+    }
+
+    double whole_ms = 0.0;
+    for (const PipelineStateCache::GraphicsDesc& variant : variants) {
+        auto start = Clock::now();
+        GraphicsPipeline graphics_pipeline{ device, variant.shaders, variant.attachment_formats, variant.state };
+        whole_ms += GetMilliseconds(start, Clock::now());
+    }
+    std::cout << "Whole pipelines: " << whole_ms / variants.size() << " ms per variant" << std::endl;
+
+    if (!device->IsGraphicsPipelineLibrarySupported()) {
+        std::cout << "Graphics pipeline libraries aren't supported (or linking them isn't fast) on this device." << std::endl;
+        return 0;
+    }
+
+    PipelineStateCache pipeline_state_cache{ device };
+
+    // Compiles the shader parts, which every other variant shares.
+    auto start = Clock::now();
+    pipeline_state_cache.GetGraphicsPipeline(variants[0]).Wait();
+    std::cout << "First variant, compiling all parts: " << GetMilliseconds(start, Clock::now()) << " ms" << std::endl;
+
+    double linked_ms = 0.0;
+    std::vector<PipelineHandle<GraphicsPipeline>> handles;
+    for (size_t variant = 1; variant < variants.size(); variant++) {
+        start = Clock::now();
+        handles.push_back(pipeline_state_cache.GetGraphicsPipeline(variants[variant]));
+        handles.back().Wait();
+        linked_ms += GetMilliseconds(start, Clock::now());
+    }
+
+    start = Clock::now();
+    for (const PipelineHandle<GraphicsPipeline>& handle : handles) {
+        handle.WaitOptimized();
+    }
+    double optimized_ms = GetMilliseconds(start, Clock::now());
+
+    std::cout << "Linked from libraries: " << linked_ms / handles.size() << " ms per variant" << std::endl;
+    std::cout << "Optimized in the background: " << optimized_ms << " ms until all were done" << std::endl;
+    std::cout << "Speedup: " << whole_ms / variants.size() / (linked_ms / handles.size()) << "x" << std::endl;
+}
@@ -3,11 +3,13 @@
 #include "GraphicsCore/Window.h"
 #include "GraphicsCore/Command.h"
 #include "GraphicsCore/Context.h"
+#include "GraphicsCore/FrameContext.h"
 #include "GraphicsCore/Resources.h"
 #include "GraphicsCore/Pipeline.h"
 #include "GraphicsCore/Shader.h"
 #include "GraphicsCore/Synchronization.h"
 #include "GraphicsCore/Utility.h"
+#include "RenderGraph/RenderGraph.h"
 
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -89,7 +91,14 @@ std::shared_ptr<Image> LoadTexture(Allocator& allocator, CommandPool& command_po
 
     texture->TransitionImage(copy_command, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     copy_command.End();
-    copy_command.Submit();
+
+    // The stage buffer and command buffer have to stay alive until the copy is done.
+    Fence copy_fence{ command_pool.GetDevice(), false };
+    copy_command.Submit(&copy_fence);
+    copy_fence.Wait(UINT64_MAX);
+    command_pool.FreeCommandBuffer(copy_command);
+
+    return texture;
 }
 
 struct Vertex {
@@ -136,7 +145,11 @@ std::shared_ptr<Buffer> CreateVertexBuffer(Allocator& allocator, CommandPool& co
     });
     
     copy_command.End();
-    copy_command.Submit();
+
+    Fence copy_fence{ command_pool.GetDevice(), false };
+    copy_command.Submit(&copy_fence);
+    copy_fence.Wait(UINT64_MAX);
+    command_pool.FreeCommandBuffer(copy_command);
 
     return vertex_buffer;
 }
@@ -175,7 +188,11 @@ std::shared_ptr<Buffer> CreateIndexBuffer(Allocator& allocator, CommandPool& com
     });
     
     copy_command.End();
-    copy_command.Submit(); 
+
+    Fence copy_fence{ command_pool.GetDevice(), false };
+    copy_command.Submit(&copy_fence);
+    copy_fence.Wait(UINT64_MAX);
+    command_pool.FreeCommandBuffer(copy_command);
 
     return index_buffer;
 }
@@ -188,19 +205,21 @@ int main() {
     Allocator allocator{ context.GetInstance(), context.GetDevice() };
     DescriptorPool descriptor_pool{ context.GetDevice() };
     CommandPool command_pool{ context.GetDevice(), Device::QueueType::GRAPHICS };
+    FrameContext frame_context{ context.GetDevice(), allocator, {.num_frames_in_flight = 2} };
 
-    Fence render_fence{context.GetDevice(), true};
-    Semaphore image_available_semaphore{context.GetDevice()};
-    Semaphore render_finished_semaphore{context.GetDevice()};
-
-    CommandBuffer main_command = command_pool.AllocateSinglePrimaryCommandBuffer();
+    // The presentation engine holds on to the render finished semaphore until the image is presented,
+    // which has nothing to do with the frame slots, so there is one per swapchain image instead.
+    std::vector<std::unique_ptr<Semaphore>> render_finished_semaphores;
+    for (uint32_t image_index = 0; image_index < context.GetSwapchain()->GetNumImages(); image_index++) {
+        render_finished_semaphores.push_back(std::make_unique<Semaphore>(context.GetDevice()));
+    }
 
     std::cout << "Loading shader compiler" << std::endl;
     ShaderCompiler compiler{context.GetDevice()};
-    std::cout << "Getting vertex shader" << std::endl;
-    std::shared_ptr<Shader> triangle_vertex_shader = compiler.LoadShader("HelloWorldGraphics", "vertex_main");
-    std::cout << "Getting fragment shader" << std::endl;
-    std::shared_ptr<Shader> triangle_fragment_shader = compiler.LoadShader("HelloWorldGraphics", "fragment_main");
+    std::cout << "Getting triangle shaders" << std::endl;
+    std::vector<std::shared_ptr<Shader>> triangle_shaders = compiler.LoadProgram("HelloWorldGraphics", {"vertex_main", "fragment_main"});
+    std::shared_ptr<Shader> triangle_vertex_shader = triangle_shaders[0];
+    std::shared_ptr<Shader> triangle_fragment_shader = triangle_shaders[1];
     GraphicsPipeline triangle_pipeline{context.GetDevice(), 
         {
             .vertex_shader = triangle_vertex_shader, 
@@ -226,24 +245,16 @@ int main() {
 
     context.GetDevice()->WaitIdle();
     
-    while (!window->ShouldClose()) {
-        window->PollEvents();
+    RenderGraph graph{context.GetDevice(), allocator};
+    // The swapchain image comes back from presentation every frame, guarded by the acquire semaphore.
+    RenderGraph::ImageHandle swapchain_handle = graph.ImportImage(context.GetSwapchain()->GetImage(0), context.GetSwapchain()->GetImageView(0), RenderGraph::Usage::PRESENT);
 
-        render_fence.Wait(1000000000);
-        render_fence.Reset();
+    graph.AddPass("Triangle", RenderGraph::PassType::GRAPHICS, [&](CommandBuffer& command_buffer) {
+        std::shared_ptr<ImageView> swapchain_image_view = graph.GetImageView(swapchain_handle);
 
-        uint32_t swapchain_index = context.GetSwapchain()->AcquireNextImage(image_available_semaphore);
-        std::shared_ptr<Image> swapchain_image = context.GetSwapchain()->GetImage(swapchain_index);
-        std::shared_ptr<ImageView> swapchain_image_view = context.GetSwapchain()->GetImageView(swapchain_index);
-
-        main_command.Reset();
-        main_command.Begin(true);
+        triangle_pipeline.Bind(command_buffer);
 
-        swapchain_image->TransitionImage(main_command, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
-        triangle_pipeline.Bind(main_command);
-
-        main_command.Record([&](VkCommandBuffer command) {
+        command_buffer.Record([&](VkCommandBuffer command) {
             VkViewport viewport = {
                 .x = 0.0f,
                 .y = 0.0f,
@@ -307,18 +318,35 @@ int main() {
 
             _vkCmdEndRenderingKHR(command);
         });
+    })
+        .Write(swapchain_handle, RenderGraph::Usage::COLOR_ATTACHMENT);
+
+    graph.ExportImage(swapchain_handle, RenderGraph::Usage::PRESENT);
+    graph.Compile();
+
+    while (!window->ShouldClose()) {
+        window->PollEvents();
+
+        // Only waits if the GPU is more than the number of frames in flight behind.
+        frame_context.BeginFrame();
 
-        swapchain_image->TransitionImage(main_command, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        Semaphore& image_available_semaphore = frame_context.GetImageAvailableSemaphore();
+        uint32_t swapchain_index = context.GetSwapchain()->AcquireNextImage(image_available_semaphore);
+        graph.RebindImportedImage(swapchain_handle, context.GetSwapchain()->GetImage(swapchain_index), context.GetSwapchain()->GetImageView(swapchain_index));
+        Semaphore& render_finished_semaphore = *render_finished_semaphores[swapchain_index];
 
+        CommandBuffer main_command = frame_context.AllocateCommandBuffer();
+        main_command.Begin(true);
+        graph.Execute(main_command);
         main_command.End();
 
         main_command.InsertWaitSemaphore(image_available_semaphore, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR);
         main_command.InsertSignalSemaphore(render_finished_semaphore, VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT);
 
-        main_command.Submit(&render_fence);
+        main_command.Submit(&frame_context.GetFence());
 
         context.GetSwapchain()->Present(swapchain_index, render_finished_semaphore);
     }
 
-    // TODO: handle exit gracefully...
+    context.GetDevice()->WaitIdle();
 }
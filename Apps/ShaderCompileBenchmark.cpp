@@ -0,0 +1,63 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "GraphicsCore/Context.h"
+#include "GraphicsCore/Shader.h"
+
+// Compiles the same set of entry points serially and through the asynchronous shader compiler,
+// and reports the wall time of both. The disk cache is disabled, so every load actually compiles.
+// Usage: ShaderCompileBenchmark [repetitions] [worker threads]
+int main(int argc, char** argv) {
+    uint32_t num_repetitions = (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1])) : 8;
+    uint32_t num_threads = (argc > 2) ? static_cast<uint32_t>(std::stoul(argv[2])) : std::thread::hardware_concurrency();
+
+    Context context{ "Shader Compile Benchmark", false };
+
+    std::vector<std::pair<std::string, std::string>> entry_points = {
+        {"HelloWorldGraphics", "vertex_main"},
+        {"HelloWorldGraphics", "fragment_main"},
+        {"HelloWorldCompute", "compute_main"},
+    };
+
+    std::vector<std::pair<std::string, std::string>> shaders;
+    for (uint32_t repetition = 0; repetition < num_repetitions; repetition++) {
+        shaders.insert(shaders.end(), entry_points.begin(), entry_points.end());
+    }
+
+    // Both runs include starting up Slang, since that is part of what compiling at startup costs.
+    auto serial_start = std::chrono::steady_clock::now();
+    {
+        ShaderCompiler compiler{ context.GetDevice(), false };
+        for (const auto& [shader_file, entry_point] : shaders) {
+            compiler.LoadShader(shader_file, entry_point);
+        }
+    }
+    auto serial_end = std::chrono::steady_clock::now();
+
+    auto parallel_start = std::chrono::steady_clock::now();
+    {
+        ShaderCompiler compiler{ context.GetDevice(), false, num_threads };
+        std::vector<std::future<std::shared_ptr<Shader>>> results;
+        for (const auto& [shader_file, entry_point] : shaders) {
+            results.push_back(compiler.LoadShaderAsync(shader_file, entry_point));
+        }
+
+        for (std::future<std::shared_ptr<Shader>>& result : results) {
+            result.get();
+        }
+    }
+    auto parallel_end = std::chrono::steady_clock::now();
+
+    double serial_ms = std::chrono::duration<double, std::milli>(serial_end - serial_start).count();
+    double parallel_ms = std::chrono::duration<double, std::milli>(parallel_end - parallel_start).count();
+
+    std::cout << "Compiled " << shaders.size() << " shaders" << std::endl;
+    std::cout << "Serial:   " << serial_ms << " ms" << std::endl;
+    std::cout << "Parallel: " << parallel_ms << " ms (" << num_threads << " threads)" << std::endl;
+    std::cout << "Speedup:  " << serial_ms / parallel_ms << "x" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a. Fast and stable across runs and platforms, which is what matters for keys
+// that end up on disk, but not suitable for anything that has to resist deliberate collisions.
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t index = 0; index < size; index++) {
+        hash ^= bytes[index];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t HashString(std::string_view string, uint64_t hash = FNV_OFFSET_BASIS) {
+    // The length goes in first, so that e.g. ("ab", "c") and ("a", "bc") hash differently when chained.
+    uint64_t length = string.size();
+    hash = HashBytes(&length, sizeof(length), hash);
+    return HashBytes(string.data(), string.size(), hash);
+}
+
+template<typename T> inline uint64_t HashValue(const T& value, uint64_t hash = FNV_OFFSET_BASIS) {
+    return HashBytes(&value, sizeof(T), hash);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(uint32_t num_threads) :
+    is_stopping_{ false }
+{
+    // hardware_concurrency() is allowed to return 0 if it can't tell.
+    num_threads = std::max(num_threads, 1u);
+
+    threads_.reserve(num_threads);
+    for (uint32_t thread_index = 0; thread_index < num_threads; thread_index++) {
+        threads_.emplace_back(&ThreadPool::WorkerLoop, this, thread_index);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        is_stopping_ = true;
+    }
+    condition_.notify_all();
+
+    // Workers finish whatever is still queued before they exit.
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t thread_index)>& function) {
+    if (count == 0) {
+        return;
+    }
+
+    // Instead of one task per index, every worker pulls indices until there are none left,
+    // so a slow index doesn't hold up the others queued behind it.
+    std::atomic<uint32_t> next_index = 0;
+    uint32_t num_tasks = std::min(count, GetNumThreads());
+
+    std::vector<std::future<void>> results;
+    results.reserve(num_tasks);
+    for (uint32_t task_index = 0; task_index < num_tasks; task_index++) {
+        results.push_back(Submit([&](uint32_t thread_index) {
+            for (uint32_t index = next_index++; index < count; index = next_index++) {
+                function(index, thread_index);
+            }
+        }));
+    }
+
+    // All tasks have to be done before returning, since they reference this stack frame.
+    for (std::future<void>& result : results) {
+        result.wait();
+    }
+    for (std::future<void>& result : results) {
+        result.get();
+    }
+}
+
+void ThreadPool::Enqueue(std::function<void(uint32_t)> task) {
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        tasks_.push(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void ThreadPool::WorkerLoop(uint32_t thread_index) {
+    while (true) {
+        std::function<void(uint32_t)> task;
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            condition_.wait(lock, [this]() {return is_stopping_ || !tasks_.empty();});
+            if (tasks_.empty()) {
+                return;
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        task(thread_index);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of worker threads working through a shared task queue. Every task is given the index
+// of the worker running it, so per-thread resources (e.g. command pools) can be indexed without locking.
+class ThreadPool {
+public:
+    ThreadPool(uint32_t num_threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F> auto Submit(F function) -> std::future<std::invoke_result_t<F, uint32_t>> {
+        using ResultType = std::invoke_result_t<F, uint32_t>;
+
+        // std::function has to be copyable, which packaged_task isn't.
+        auto task = std::make_shared<std::packaged_task<ResultType(uint32_t)>>(std::move(function));
+        std::future<ResultType> result = task->get_future();
+        Enqueue([task](uint32_t thread_index) {(*task)(thread_index);});
+        return result;
+    }
+
+    // Calls the function for every index in [0, count) on the workers, and blocks until all calls are done.
+    // Exceptions thrown by the function are rethrown here. Must not be called from one of the workers.
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t thread_index)>& function);
+
+    inline uint32_t GetNumThreads() const {return static_cast<uint32_t>(threads_.size());}
+
+private:
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::queue<std::function<void(uint32_t)>> tasks_;
+    bool is_stopping_;
+
+    void Enqueue(std::function<void(uint32_t)> task);
+    void WorkerLoop(uint32_t thread_index);
+};
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "BindlessHeap.h"
+
+#include <cassert>
+#include <stdexcept>
+
+#include "LayoutCache.h"
+
+// Well below the update-after-bind limits every device with descriptor indexing has to support (500000 per stage).
+static constexpr uint32_t HEAP_CAPACITIES[BindlessHeap::MAX_RESOURCE_TYPES] = {
+    16384, // SAMPLED_IMAGE
+    4096,  // STORAGE_IMAGE
+    16384, // STORAGE_BUFFER
+    256,   // SAMPLER
+};
+
+static constexpr VkDescriptorType HEAP_DESCRIPTOR_TYPES[BindlessHeap::MAX_RESOURCE_TYPES] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+};
+
+std::vector<DescriptorSetLayout::BindingInfo> BindlessHeap::GetBindings() {
+    std::vector<DescriptorSetLayout::BindingInfo> bindings;
+    for (uint32_t resource_type = 0; resource_type < MAX_RESOURCE_TYPES; resource_type++) {
+        bindings.push_back({
+            .binding = resource_type,
+            .descriptor_type = HEAP_DESCRIPTOR_TYPES[resource_type],
+            .descriptor_count = HEAP_CAPACITIES[resource_type],
+            .stage_flags = VK_SHADER_STAGE_ALL,
+            .binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                             VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+        });
+    }
+    return bindings;
+}
+
+BindlessHeap::BindlessHeap(std::shared_ptr<Device> device) :
+    device_{ device },
+    descriptor_pool_{ device, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, 1 }
+{
+    if (!device_->IsBindlessSupported()) {
+        throw std::runtime_error("Failed to create bindless heap, descriptor indexing isn't supported!");
+    }
+
+    if (device_->UsesDescriptorBuffers()) {
+        throw std::runtime_error("Failed to create bindless heap, it isn't supported with descriptor buffers!");
+    }
+
+    // The layout comes from the cache, so it is the same one shaders get for the heap's set.
+    layout_ = device_->GetLayoutCache().GetDescriptorSetLayout(GetBindings());
+    descriptor_set_ = descriptor_pool_.AllocateDescriptorSet(layout_);
+
+    for (uint32_t resource_type = 0; resource_type < MAX_RESOURCE_TYPES; resource_type++) {
+        index_allocators_[resource_type] = IndexAllocator{
+            .capacity = HEAP_CAPACITIES[resource_type],
+            .next_index = 0,
+        };
+    }
+}
+
+uint32_t BindlessHeap::AddSampledImage(std::shared_ptr<ImageView> image_view, VkImageLayout image_layout) {
+    VkDescriptorImageInfo image_info = {
+        .imageView = image_view->GetImageView(),
+        .imageLayout = image_layout,
+    };
+
+    uint32_t index = AllocateIndex(SAMPLED_IMAGE, image_view);
+    WriteDescriptor(SAMPLED_IMAGE, index, &image_info, nullptr);
+    return index;
+}
+
+uint32_t BindlessHeap::AddStorageImage(std::shared_ptr<ImageView> image_view) {
+    VkDescriptorImageInfo image_info = {
+        .imageView = image_view->GetImageView(),
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+
+    uint32_t index = AllocateIndex(STORAGE_IMAGE, image_view);
+    WriteDescriptor(STORAGE_IMAGE, index, &image_info, nullptr);
+    return index;
+}
+
+uint32_t BindlessHeap::AddStorageBuffer(std::shared_ptr<Buffer> buffer, VkDeviceSize offset, VkDeviceSize range) {
+    VkDescriptorBufferInfo buffer_info = {
+        .buffer = buffer->GetBuffer(),
+        .offset = offset,
+        .range = range,
+    };
+
+    uint32_t index = AllocateIndex(STORAGE_BUFFER, buffer);
+    WriteDescriptor(STORAGE_BUFFER, index, nullptr, &buffer_info);
+    return index;
+}
+
+uint32_t BindlessHeap::AddSampler(std::shared_ptr<Sampler> sampler) {
+    VkDescriptorImageInfo image_info = {
+        .sampler = sampler->GetSampler(),
+    };
+
+    uint32_t index = AllocateIndex(SAMPLER, sampler);
+    WriteDescriptor(SAMPLER, index, &image_info, nullptr);
+    return index;
+}
+
+void BindlessHeap::Remove(ResourceType resource_type, uint32_t index) {
+    assert(index < resources_[resource_type].size() && resources_[resource_type][index] != nullptr);
+
+    // The descriptor itself is left as it is, the array is partially bound and nothing should be indexing it anymore.
+    resources_[resource_type][index] = nullptr;
+    index_allocators_[resource_type].free_indices.push_back(index);
+}
+
+uint32_t BindlessHeap::AllocateIndex(ResourceType resource_type, std::shared_ptr<void> resource) {
+    IndexAllocator& index_allocator = index_allocators_[resource_type];
+
+    uint32_t index;
+    if (!index_allocator.free_indices.empty()) {
+        index = index_allocator.free_indices.back();
+        index_allocator.free_indices.pop_back();
+    } else if (index_allocator.next_index < index_allocator.capacity) {
+        index = index_allocator.next_index++;
+        resources_[resource_type].resize(index_allocator.next_index);
+    } else {
+        throw std::runtime_error("Failed to add resource to the bindless heap, it is full!");
+    }
+
+    resources_[resource_type][index] = std::move(resource);
+    return index;
+}
+
+void BindlessHeap::WriteDescriptor(ResourceType resource_type, uint32_t index, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info) {
+    VkWriteDescriptorSet descriptor_write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = descriptor_set_->GetDescriptorSet(),
+        .dstBinding = static_cast<uint32_t>(resource_type),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = HEAP_DESCRIPTOR_TYPES[resource_type],
+        .pImageInfo = image_info,
+        .pBufferInfo = buffer_info,
+    };
+
+    vkUpdateDescriptorSets(device_->GetLogicalDevice(), 1, &descriptor_write, 0, nullptr);
+}
\ No newline at end of file
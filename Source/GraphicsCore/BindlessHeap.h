@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Device.h"
+#include "Parameters.h"
+#include "Resources.h"
+
+// One big descriptor set with arrays of sampled images, storage images, storage buffers and samplers, that shaders
+// index into (see Shaders/Bindless.slang). Resources are added once and referred to by their index from then on,
+// so the set is bound once per command buffer instead of binding and writing descriptors for every draw.
+// The arrays are partially bound and updated after bind, so adding resources never disturbs work in flight.
+// Needs Device::IsBindlessSupported().
+class BindlessHeap {
+public:
+    // Shaders that use the heap get the heap's layout for this set, whatever they use of it,
+    // so all of their pipelines are compatible with the heap's set.
+    static constexpr uint32_t SET = 3;
+
+    // Also the binding number of each array.
+    enum ResourceType {
+        SAMPLED_IMAGE,
+        STORAGE_IMAGE,
+        STORAGE_BUFFER,
+        SAMPLER,
+        MAX_RESOURCE_TYPES,
+    };
+
+    static std::vector<DescriptorSetLayout::BindingInfo> GetBindings();
+
+    BindlessHeap(std::shared_ptr<Device> device);
+    ~BindlessHeap() = default;
+
+    BindlessHeap(const BindlessHeap&) = delete;
+    BindlessHeap& operator=(const BindlessHeap&) = delete;
+
+    // The heap keeps the resources alive until they are removed.
+    uint32_t AddSampledImage(std::shared_ptr<ImageView> image_view, VkImageLayout image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uint32_t AddStorageImage(std::shared_ptr<ImageView> image_view);
+    uint32_t AddStorageBuffer(std::shared_ptr<Buffer> buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+    uint32_t AddSampler(std::shared_ptr<Sampler> sampler);
+
+    // The index is handed out again by the next add, so nothing in flight may still use it.
+    void Remove(ResourceType resource_type, uint32_t index);
+
+    inline std::shared_ptr<DescriptorSetLayout> GetLayout() const {return layout_;}
+    inline std::shared_ptr<DescriptorSet> GetDescriptorSet() const {return descriptor_set_;}
+
+private:
+    // Indices are handed out in order, and removed ones are reused first.
+    struct IndexAllocator {
+        uint32_t capacity;
+        uint32_t next_index;
+        std::vector<uint32_t> free_indices;
+    };
+
+    std::shared_ptr<Device> device_;
+
+    DescriptorPool descriptor_pool_;
+    std::shared_ptr<DescriptorSetLayout> layout_;
+    std::shared_ptr<DescriptorSet> descriptor_set_;
+
+    IndexAllocator index_allocators_[MAX_RESOURCE_TYPES];
+    std::vector<std::shared_ptr<void>> resources_[MAX_RESOURCE_TYPES];
+
+    uint32_t AllocateIndex(ResourceType resource_type, std::shared_ptr<void> resource);
+    void WriteDescriptor(ResourceType resource_type, uint32_t index, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info);
+};
@@ -1,10 +1,12 @@
 #include "Command.h"
 
+#include <cassert>
 #include <stdexcept>
 
 CommandBuffer::CommandBuffer(VkCommandBuffer command_buffer, const Device::Queue& queue) :
     queue_{ queue },
-    command_buffer_{ command_buffer }
+    command_buffer_{ command_buffer },
+    dynamic_state_{ nullptr }
 {}
 
 void CommandBuffer::Reset() {
@@ -28,6 +30,33 @@ void CommandBuffer::Begin(bool use_once) {
     }
 }
 
+void CommandBuffer::BeginSecondary(bool use_once) {
+    VkCommandBufferInheritanceInfo inheritance_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+    };
+
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pInheritanceInfo = &inheritance_info,
+    };
+
+    if (use_once) {
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    }
+
+    if (vkBeginCommandBuffer(command_buffer_, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin secondary command buffer!");
+    }
+}
+
+void CommandBuffer::ExecuteCommands(const std::vector<VkCommandBuffer>& secondary_command_buffers) {
+    if (secondary_command_buffers.empty()) {
+        return;
+    }
+
+    vkCmdExecuteCommands(command_buffer_, static_cast<uint32_t>(secondary_command_buffers.size()), secondary_command_buffers.data());
+}
+
 void CommandBuffer::End() {
     if (vkEndCommandBuffer(command_buffer_) != VK_SUCCESS) {
         throw std::runtime_error("Failed to begin command buffer!");
@@ -56,28 +85,33 @@ void CommandBuffer::Submit(Fence* fence) {
     }
 }
 
-void CommandBuffer::InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags stage_mask) {
-    VkSemaphoreSubmitInfo semaphore_info = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-        .semaphore = semaphore.GetSemaphore(),
-        .value = 1,
-        .stageMask = stage_mask,
-        .deviceIndex = 0,
-    };
+// The value is ignored for binary semaphores.
+void CommandBuffer::InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask) {
+    InsertSemaphore(wait_semaphores_, semaphore.GetSemaphore(), 0, stage_mask);
+}
+
+void CommandBuffer::InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask) {
+    InsertSemaphore(signal_semaphores_, semaphore.GetSemaphore(), 0, stage_mask);
+}
+
+void CommandBuffer::InsertWaitSemaphore(TimelineSemaphore& semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask) {
+    InsertSemaphore(wait_semaphores_, semaphore.GetSemaphore(), value, stage_mask);
+}
 
-    wait_semaphores_.push_back(semaphore_info);
+void CommandBuffer::InsertSignalSemaphore(TimelineSemaphore& semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask) {
+    InsertSemaphore(signal_semaphores_, semaphore.GetSemaphore(), value, stage_mask);
 }
 
-void CommandBuffer::InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags stage_mask) {
+void CommandBuffer::InsertSemaphore(std::vector<VkSemaphoreSubmitInfo>& semaphores, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask) {
     VkSemaphoreSubmitInfo semaphore_info = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-        .semaphore = semaphore.GetSemaphore(),
-        .value = 1,
+        .semaphore = semaphore,
+        .value = value,
         .stageMask = stage_mask,
         .deviceIndex = 0,
     };
 
-    signal_semaphores_.push_back(semaphore_info);
+    semaphores.push_back(semaphore_info);
 }
 
 CommandPool::CommandPool(std::shared_ptr<Device> device, Device::QueueType queue_type) :
@@ -123,3 +157,91 @@ CommandBuffer CommandPool::AllocateSinglePrimaryCommandBuffer() const {
     }
     return CommandBuffer{command_buffer, device_->GetQueue(queue_type_)};
 }
+
+void CommandPool::FreeCommandBuffer(const CommandBuffer& command_buffer) const {
+    VkCommandBuffer vk_command_buffer = command_buffer.GetCommandBuffer();
+    vkFreeCommandBuffers(device_->GetLogicalDevice(), command_pool_, 1, &vk_command_buffer);
+}
+
+CommandPoolRing::CommandPoolRing(std::shared_ptr<Device> device, Device::QueueType queue_type, uint32_t num_frames, uint32_t num_threads) :
+    device_{ device },
+    queue_type_{ queue_type },
+    num_frames_{ num_frames },
+    num_threads_{ num_threads },
+    frame_index_{ 0 }
+{
+    assert(num_frames_ > 0 && num_threads_ > 0);
+    CreateCommandPools();
+}
+
+CommandPoolRing::~CommandPoolRing() {
+    if (!pools_.empty()) {
+        device_->WaitIdle();
+    }
+
+    for (Pool& pool : pools_) {
+        vkDestroyCommandPool(device_->GetLogicalDevice(), pool.command_pool, nullptr);
+    }
+    pools_.clear();
+}
+
+void CommandPoolRing::BeginFrame(uint32_t frame_index) {
+    assert(frame_index < num_frames_);
+    frame_index_ = frame_index;
+
+    for (uint32_t thread_index = 0; thread_index < num_threads_; thread_index++) {
+        Pool& pool = pools_[frame_index_ * num_threads_ + thread_index];
+        if (pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_PRIMARY] == 0 && pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_SECONDARY] == 0) {
+            continue;
+        }
+
+        if (vkResetCommandPool(device_->GetLogicalDevice(), pool.command_pool, 0) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to reset command pool!");
+        }
+        pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_PRIMARY] = 0;
+        pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_SECONDARY] = 0;
+    }
+}
+
+CommandBuffer CommandPoolRing::AllocateCommandBuffer(uint32_t thread_index, VkCommandBufferLevel level) {
+    assert(thread_index < num_threads_);
+    Pool& pool = pools_[frame_index_ * num_threads_ + thread_index];
+    std::vector<VkCommandBuffer>& command_buffers = pool.command_buffers[level];
+    uint32_t& num_used_command_buffers = pool.num_used_command_buffers[level];
+
+    // Command buffers are only ever allocated when a frame needs more than any time before.
+    if (num_used_command_buffers == command_buffers.size()) {
+        VkCommandBufferAllocateInfo command_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool.command_pool,
+            .level = level,
+            .commandBufferCount = 1,
+        };
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(device_->GetLogicalDevice(), &command_info, &command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffer!");
+        }
+        command_buffers.push_back(command_buffer);
+    }
+
+    return CommandBuffer{command_buffers[num_used_command_buffers++], device_->GetQueue(queue_type_)};
+}
+
+void CommandPoolRing::CreateCommandPools() {
+    uint32_t queue_family = device_->GetQueue(queue_type_).queue_family;
+    VkCommandPoolCreateInfo pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_family,
+    };
+
+    pools_.resize(num_frames_ * num_threads_);
+    for (Pool& pool : pools_) {
+        pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_PRIMARY] = 0;
+        pool.num_used_command_buffers[VK_COMMAND_BUFFER_LEVEL_SECONDARY] = 0;
+        if (vkCreateCommandPool(device_->GetLogicalDevice(), &pool_info, nullptr, &pool.command_pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+    }
+}
\ No newline at end of file
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
 #include "Device.h"
 #include "Synchronization.h"
 
+class DynamicStateTracker;
+
 class CommandBuffer {
 public:
     CommandBuffer(VkCommandBuffer command_buffer, const Device::Queue& queue);
@@ -15,6 +18,11 @@ public:
 
     void Begin(bool use_once);
 
+    // Secondary command buffers recorded outside of a render pass don't inherit any state,
+    // and are executed by a primary command buffer instead of being submitted on their own.
+    void BeginSecondary(bool use_once);
+    void ExecuteCommands(const std::vector<VkCommandBuffer>& secondary_command_buffers);
+
     template<typename T> void Record(T commands) {
         commands(command_buffer_);
     }
@@ -22,15 +30,27 @@ public:
     void End();
     void Submit(Fence* fence = nullptr);
 
-    void InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags stage_mask);
-    void InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags stage_mask);
+    inline VkCommandBuffer GetCommandBuffer() const {return command_buffer_;}
+
+    // The tracker of the state set for shader objects, while the command buffer is recorded by a RenderGraph
+    // on a device that uses them. Null otherwise.
+    inline DynamicStateTracker* GetDynamicState() const {return dynamic_state_;}
+    inline void SetDynamicState(DynamicStateTracker* dynamic_state) {dynamic_state_ = dynamic_state;}
+
+    void InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask);
+    void InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask);
+    void InsertWaitSemaphore(TimelineSemaphore& semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask);
+    void InsertSignalSemaphore(TimelineSemaphore& semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask);
 
 private:
     const Device::Queue& queue_;
     VkCommandBuffer command_buffer_;
+    DynamicStateTracker* dynamic_state_;
 
     std::vector<VkSemaphoreSubmitInfo> wait_semaphores_;
     std::vector<VkSemaphoreSubmitInfo> signal_semaphores_;
+
+    void InsertSemaphore(std::vector<VkSemaphoreSubmitInfo>& semaphores, VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stage_mask);
 };
 
 class CommandPool {
@@ -39,6 +59,9 @@ public:
     ~CommandPool();
 
     CommandBuffer AllocateSinglePrimaryCommandBuffer() const;
+    void FreeCommandBuffer(const CommandBuffer& command_buffer) const;
+
+    inline std::shared_ptr<Device> GetDevice() const {return device_;}
 
 private:
     std::shared_ptr<Device> device_;
@@ -47,3 +70,40 @@ private:
 
     void CreateCommandPool();
 };
+
+// Hands out command buffers for a fixed number of frames in flight, with one pool per frame and thread.
+// Instead of resetting command buffers one by one, all pools of a frame are reset at once when the frame
+// comes around again, and their command buffers are handed out again in order. Command buffers from the
+// ring must not be reset individually.
+class CommandPoolRing {
+public:
+    CommandPoolRing(std::shared_ptr<Device> device, Device::QueueType queue_type, uint32_t num_frames, uint32_t num_threads = 1);
+    ~CommandPoolRing();
+
+    // Resets all pools of the given frame. Everything recorded for that frame last time must be done executing.
+    void BeginFrame(uint32_t frame_index);
+
+    // Each thread has to use its own thread index, since command pools can't be used from several threads at once.
+    CommandBuffer AllocateCommandBuffer(uint32_t thread_index = 0, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    inline uint32_t GetFrameIndex() const {return frame_index_;}
+    inline uint32_t GetNumFrames() const {return num_frames_;}
+    inline uint32_t GetNumThreads() const {return num_threads_;}
+
+private:
+    struct Pool {
+        VkCommandPool command_pool;
+        std::vector<VkCommandBuffer> command_buffers[2];
+        uint32_t num_used_command_buffers[2];
+    };
+
+    std::shared_ptr<Device> device_;
+    Device::QueueType queue_type_;
+    uint32_t num_frames_;
+    uint32_t num_threads_;
+    uint32_t frame_index_;
+
+    std::vector<Pool> pools_;
+
+    void CreateCommandPools();
+};
\ No newline at end of file
@@ -7,7 +7,38 @@
 PFN_vkCmdBeginRenderingKHR _vkCmdBeginRenderingKHR;
 PFN_vkCmdEndRenderingKHR _vkCmdEndRenderingKHR;
 
-Context::Context(const std::string& app_name, size_t width, size_t height) :
+PFN_vkGetDescriptorSetLayoutSizeEXT _vkGetDescriptorSetLayoutSizeEXT;
+PFN_vkGetDescriptorSetLayoutBindingOffsetEXT _vkGetDescriptorSetLayoutBindingOffsetEXT;
+PFN_vkGetDescriptorEXT _vkGetDescriptorEXT;
+PFN_vkCmdBindDescriptorBuffersEXT _vkCmdBindDescriptorBuffersEXT;
+PFN_vkCmdSetDescriptorBufferOffsetsEXT _vkCmdSetDescriptorBufferOffsetsEXT;
+
+PFN_vkCreateShadersEXT _vkCreateShadersEXT;
+PFN_vkDestroyShaderEXT _vkDestroyShaderEXT;
+PFN_vkCmdBindShadersEXT _vkCmdBindShadersEXT;
+PFN_vkCmdSetViewportWithCountEXT _vkCmdSetViewportWithCountEXT;
+PFN_vkCmdSetScissorWithCountEXT _vkCmdSetScissorWithCountEXT;
+PFN_vkCmdSetVertexInputEXT _vkCmdSetVertexInputEXT;
+PFN_vkCmdSetPrimitiveTopologyEXT _vkCmdSetPrimitiveTopologyEXT;
+PFN_vkCmdSetPrimitiveRestartEnableEXT _vkCmdSetPrimitiveRestartEnableEXT;
+PFN_vkCmdSetRasterizerDiscardEnableEXT _vkCmdSetRasterizerDiscardEnableEXT;
+PFN_vkCmdSetPolygonModeEXT _vkCmdSetPolygonModeEXT;
+PFN_vkCmdSetCullModeEXT _vkCmdSetCullModeEXT;
+PFN_vkCmdSetFrontFaceEXT _vkCmdSetFrontFaceEXT;
+PFN_vkCmdSetDepthBiasEnableEXT _vkCmdSetDepthBiasEnableEXT;
+PFN_vkCmdSetRasterizationSamplesEXT _vkCmdSetRasterizationSamplesEXT;
+PFN_vkCmdSetSampleMaskEXT _vkCmdSetSampleMaskEXT;
+PFN_vkCmdSetAlphaToCoverageEnableEXT _vkCmdSetAlphaToCoverageEnableEXT;
+PFN_vkCmdSetDepthTestEnableEXT _vkCmdSetDepthTestEnableEXT;
+PFN_vkCmdSetDepthWriteEnableEXT _vkCmdSetDepthWriteEnableEXT;
+PFN_vkCmdSetDepthCompareOpEXT _vkCmdSetDepthCompareOpEXT;
+PFN_vkCmdSetDepthBoundsTestEnableEXT _vkCmdSetDepthBoundsTestEnableEXT;
+PFN_vkCmdSetStencilTestEnableEXT _vkCmdSetStencilTestEnableEXT;
+PFN_vkCmdSetColorBlendEnableEXT _vkCmdSetColorBlendEnableEXT;
+PFN_vkCmdSetColorBlendEquationEXT _vkCmdSetColorBlendEquationEXT;
+PFN_vkCmdSetColorWriteMaskEXT _vkCmdSetColorWriteMaskEXT;
+
+Context::Context(const std::string& app_name, size_t width, size_t height, Device::DescriptorModel descriptor_model, Device::ShaderModel shader_model) :
     app_name_{ app_name }
 {
     window_ = std::make_shared<Window>(app_name, width, height);
@@ -46,12 +77,65 @@ Context::Context(const std::string& app_name, size_t width, size_t height) :
     // is that the instance already relies on the window to query for extensions,
     // so there is currently a circular dependency between the two classes.
     VkSurfaceKHR surface = window_->CreateSurface(instance_->GetInstance());
-    device_ = std::make_shared<Device>(instance_, surface);
+    device_ = std::make_shared<Device>(instance_, surface, descriptor_model, shader_model);
     vkDestroySurfaceKHR(instance_->GetInstance(), surface, nullptr);
 
     swapchain_ = std::make_shared<Swapchain>(instance_, device_, window_);
 
-    // Load functions here
+    LoadFunctions();
+}
+
+Context::Context(const std::string& app_name, bool enable_validation, Device::DescriptorModel descriptor_model, Device::ShaderModel shader_model) :
+    app_name_{ app_name }
+{
+    // Without a window there is no need for any surface extensions, and nothing touches GLFW.
+    std::vector<std::string> requested_validation_layers;
+    if (enable_validation) {
+        requested_validation_layers.push_back("VK_LAYER_KHRONOS_validation");
+    }
+
+    instance_ = std::make_shared<Instance>(app_name_, requested_validation_layers, std::vector<std::string>{});
+    device_ = std::make_shared<Device>(instance_, VK_NULL_HANDLE, descriptor_model, shader_model);
+
+    LoadFunctions();
+}
+
+void Context::LoadFunctions() {
     _vkCmdBeginRenderingKHR = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdBeginRenderingKHR"));
     _vkCmdEndRenderingKHR = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdEndRenderingKHR"));
+
+    if (device_->UsesDescriptorBuffers()) {
+        _vkGetDescriptorSetLayoutSizeEXT = reinterpret_cast<PFN_vkGetDescriptorSetLayoutSizeEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkGetDescriptorSetLayoutSizeEXT"));
+        _vkGetDescriptorSetLayoutBindingOffsetEXT = reinterpret_cast<PFN_vkGetDescriptorSetLayoutBindingOffsetEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkGetDescriptorSetLayoutBindingOffsetEXT"));
+        _vkGetDescriptorEXT = reinterpret_cast<PFN_vkGetDescriptorEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkGetDescriptorEXT"));
+        _vkCmdBindDescriptorBuffersEXT = reinterpret_cast<PFN_vkCmdBindDescriptorBuffersEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdBindDescriptorBuffersEXT"));
+        _vkCmdSetDescriptorBufferOffsetsEXT = reinterpret_cast<PFN_vkCmdSetDescriptorBufferOffsetsEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDescriptorBufferOffsetsEXT"));
+    }
+
+    if (device_->UsesShaderObjects()) {
+        _vkCreateShadersEXT = reinterpret_cast<PFN_vkCreateShadersEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCreateShadersEXT"));
+        _vkDestroyShaderEXT = reinterpret_cast<PFN_vkDestroyShaderEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkDestroyShaderEXT"));
+        _vkCmdBindShadersEXT = reinterpret_cast<PFN_vkCmdBindShadersEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdBindShadersEXT"));
+        _vkCmdSetViewportWithCountEXT = reinterpret_cast<PFN_vkCmdSetViewportWithCountEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetViewportWithCountEXT"));
+        _vkCmdSetScissorWithCountEXT = reinterpret_cast<PFN_vkCmdSetScissorWithCountEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetScissorWithCountEXT"));
+        _vkCmdSetVertexInputEXT = reinterpret_cast<PFN_vkCmdSetVertexInputEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetVertexInputEXT"));
+        _vkCmdSetPrimitiveTopologyEXT = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetPrimitiveTopologyEXT"));
+        _vkCmdSetPrimitiveRestartEnableEXT = reinterpret_cast<PFN_vkCmdSetPrimitiveRestartEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetPrimitiveRestartEnableEXT"));
+        _vkCmdSetRasterizerDiscardEnableEXT = reinterpret_cast<PFN_vkCmdSetRasterizerDiscardEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetRasterizerDiscardEnableEXT"));
+        _vkCmdSetPolygonModeEXT = reinterpret_cast<PFN_vkCmdSetPolygonModeEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetPolygonModeEXT"));
+        _vkCmdSetCullModeEXT = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetCullModeEXT"));
+        _vkCmdSetFrontFaceEXT = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetFrontFaceEXT"));
+        _vkCmdSetDepthBiasEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthBiasEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDepthBiasEnableEXT"));
+        _vkCmdSetRasterizationSamplesEXT = reinterpret_cast<PFN_vkCmdSetRasterizationSamplesEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetRasterizationSamplesEXT"));
+        _vkCmdSetSampleMaskEXT = reinterpret_cast<PFN_vkCmdSetSampleMaskEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetSampleMaskEXT"));
+        _vkCmdSetAlphaToCoverageEnableEXT = reinterpret_cast<PFN_vkCmdSetAlphaToCoverageEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetAlphaToCoverageEnableEXT"));
+        _vkCmdSetDepthTestEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDepthTestEnableEXT"));
+        _vkCmdSetDepthWriteEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDepthWriteEnableEXT"));
+        _vkCmdSetDepthCompareOpEXT = reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDepthCompareOpEXT"));
+        _vkCmdSetDepthBoundsTestEnableEXT = reinterpret_cast<PFN_vkCmdSetDepthBoundsTestEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetDepthBoundsTestEnableEXT"));
+        _vkCmdSetStencilTestEnableEXT = reinterpret_cast<PFN_vkCmdSetStencilTestEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetStencilTestEnableEXT"));
+        _vkCmdSetColorBlendEnableEXT = reinterpret_cast<PFN_vkCmdSetColorBlendEnableEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetColorBlendEnableEXT"));
+        _vkCmdSetColorBlendEquationEXT = reinterpret_cast<PFN_vkCmdSetColorBlendEquationEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetColorBlendEquationEXT"));
+        _vkCmdSetColorWriteMaskEXT = reinterpret_cast<PFN_vkCmdSetColorWriteMaskEXT>(vkGetDeviceProcAddr(device_->GetLogicalDevice(), "vkCmdSetColorWriteMaskEXT"));
+    }
 }
@@ -13,9 +13,17 @@
 
 class Context {
 public:
-    Context(const std::string& app_name, size_t width, size_t height);
+    Context(const std::string& app_name, size_t width, size_t height, Device::DescriptorModel descriptor_model = Device::DESCRIPTOR_SETS,
+            Device::ShaderModel shader_model = Device::PIPELINES);
+    // A headless context has no window, surface or swapchain, so it runs without a display (e.g. on a
+    // software driver in CI). Rendering has to go to offscreen images, and the window and swapchain are null.
+    // Validation is off by default, since the layer usually isn't installed where headless contexts run.
+    explicit Context(const std::string& app_name, bool enable_validation = false, Device::DescriptorModel descriptor_model = Device::DESCRIPTOR_SETS,
+                     Device::ShaderModel shader_model = Device::PIPELINES);
     ~Context() = default; 
 
+    inline bool IsHeadless() const {return window_ == nullptr;}
+
     std::shared_ptr<Window> GetWindow() {return window_;}
     std::shared_ptr<Instance> GetInstance() {return instance_;}
     std::shared_ptr<Device> GetDevice() {return device_;}
@@ -29,4 +37,6 @@ private:
     std::shared_ptr<Instance> instance_;
     std::shared_ptr<Device> device_;
     std::shared_ptr<Swapchain> swapchain_;
+
+    void LoadFunctions();
 };
@@ -0,0 +1,225 @@
+#include "DescriptorBuffer.h"
+
+#include <cassert>
+#include <stdexcept>
+
+#include "Utility.h"
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+DescriptorBuffer::DescriptorBuffer(std::shared_ptr<Device> device, Allocator& allocator, const Desc& buffer_desc) :
+    device_{ device },
+    buffer_desc_{ buffer_desc },
+    frame_index_{ 0 },
+    frame_offset_{ 0 }
+{
+    if (!device_->UsesDescriptorBuffers()) {
+        throw std::runtime_error("Failed to create descriptor buffer, the device doesn't use descriptor buffers!");
+    }
+
+    assert(buffer_desc_.num_frames_in_flight > 0);
+
+    // Every frame's region has to start at an offset sets can be bound at.
+    buffer_desc_.frame_size = AlignUp(buffer_desc_.frame_size, device_->GetDescriptorBufferProperties().descriptorBufferOffsetAlignment);
+
+    buffer_ = allocator.AllocateBuffer({
+        .buffer_size = static_cast<uint32_t>(buffer_desc_.frame_size * buffer_desc_.num_frames_in_flight),
+        .buffer_usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+                        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        .resource_desc = {
+            .allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+        }
+    });
+    buffer_data_ = static_cast<uint8_t*>(buffer_->MapToCPU());
+
+    VkBufferDeviceAddressInfo address_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer_->GetBuffer(),
+    };
+    buffer_address_ = vkGetBufferDeviceAddress(device_->GetLogicalDevice(), &address_info);
+}
+
+DescriptorBuffer::~DescriptorBuffer() {
+    buffer_->UnmapFromCPU();
+}
+
+void DescriptorBuffer::BeginFrame(uint32_t frame_index) {
+    assert(frame_index < buffer_desc_.num_frames_in_flight);
+    frame_index_ = frame_index;
+    frame_offset_ = 0;
+}
+
+DescriptorBuffer::Allocation DescriptorBuffer::AllocateDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout) {
+    VkDeviceSize layout_size;
+    _vkGetDescriptorSetLayoutSizeEXT(device_->GetLogicalDevice(), layout->GetLayout(), &layout_size);
+
+    VkDeviceSize offset = AlignUp(frame_offset_, device_->GetDescriptorBufferProperties().descriptorBufferOffsetAlignment);
+    if (offset + layout_size > buffer_desc_.frame_size) {
+        throw std::runtime_error("Failed to allocate descriptor set, the frame's descriptor buffer is full!");
+    }
+    frame_offset_ = offset + layout_size;
+
+    VkDeviceSize buffer_offset = frame_index_ * buffer_desc_.frame_size + offset;
+    return Allocation{layout, buffer_offset, buffer_data_ + buffer_offset};
+}
+
+void DescriptorBuffer::WriteBuffer(const Allocation& allocation, uint32_t binding, std::shared_ptr<Buffer> buffer, VkDeviceSize offset, VkDeviceSize range, uint32_t array_element) {
+    assert(range != VK_WHOLE_SIZE);
+
+    VkBufferDeviceAddressInfo buffer_address_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer->GetBuffer(),
+    };
+
+    VkDescriptorAddressInfoEXT address_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+        .address = vkGetBufferDeviceAddress(device_->GetLogicalDevice(), &buffer_address_info) + offset,
+        .range = range,
+    };
+
+    VkDescriptorGetInfoEXT get_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = allocation.layout->GetType(binding),
+    };
+
+    switch (get_info.type) {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: {
+            get_info.data.pUniformBuffer = &address_info;
+            break;
+        }
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+            get_info.data.pStorageBuffer = &address_info;
+            break;
+        }
+        default: {
+            throw std::runtime_error("Failed to write descriptor, the binding isn't a uniform or storage buffer!");
+        }
+    }
+
+    WriteDescriptor(allocation, binding, array_element, get_info);
+}
+
+void DescriptorBuffer::WriteImage(const Allocation& allocation, uint32_t binding, std::shared_ptr<ImageView> image_view, VkImageLayout image_layout, uint32_t array_element) {
+    VkDescriptorImageInfo image_info = {
+        .imageView = image_view->GetImageView(),
+        .imageLayout = image_layout,
+    };
+
+    VkDescriptorGetInfoEXT get_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = allocation.layout->GetType(binding),
+    };
+
+    switch (get_info.type) {
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: {
+            get_info.data.pSampledImage = &image_info;
+            break;
+        }
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: {
+            get_info.data.pStorageImage = &image_info;
+            break;
+        }
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: {
+            get_info.data.pInputAttachmentImage = &image_info;
+            break;
+        }
+        default: {
+            throw std::runtime_error("Failed to write descriptor, the binding isn't an image!");
+        }
+    }
+
+    WriteDescriptor(allocation, binding, array_element, get_info);
+}
+
+void DescriptorBuffer::WriteCombinedImageSampler(const Allocation& allocation, uint32_t binding, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler,
+                                                 VkImageLayout image_layout, uint32_t array_element) {
+    assert(allocation.layout->GetType(binding) == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+    VkDescriptorImageInfo image_info = {
+        .sampler = sampler->GetSampler(),
+        .imageView = image_view->GetImageView(),
+        .imageLayout = image_layout,
+    };
+
+    VkDescriptorGetInfoEXT get_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    };
+    get_info.data.pCombinedImageSampler = &image_info;
+
+    WriteDescriptor(allocation, binding, array_element, get_info);
+}
+
+void DescriptorBuffer::WriteSampler(const Allocation& allocation, uint32_t binding, std::shared_ptr<Sampler> sampler, uint32_t array_element) {
+    assert(allocation.layout->GetType(binding) == VK_DESCRIPTOR_TYPE_SAMPLER);
+
+    VkSampler sampler_handle = sampler->GetSampler();
+    VkDescriptorGetInfoEXT get_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+        .type = VK_DESCRIPTOR_TYPE_SAMPLER,
+    };
+    get_info.data.pSampler = &sampler_handle;
+
+    WriteDescriptor(allocation, binding, array_element, get_info);
+}
+
+void DescriptorBuffer::Bind(CommandBuffer command_buffer) const {
+    VkDescriptorBufferBindingInfoEXT binding_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+        .address = buffer_address_,
+        .usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT,
+    };
+
+    command_buffer.Record([&](VkCommandBuffer command) {
+        _vkCmdBindDescriptorBuffersEXT(command, 1, &binding_info);
+    });
+}
+
+void DescriptorBuffer::BindDescriptorSet(CommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set, const Allocation& allocation) const {
+    // Everything lives in the one buffer bound by Bind().
+    uint32_t buffer_index = 0;
+    command_buffer.Record([&](VkCommandBuffer command) {
+        _vkCmdSetDescriptorBufferOffsetsEXT(command, bind_point, pipeline_layout, set, 1, &buffer_index, &allocation.offset);
+    });
+}
+
+size_t DescriptorBuffer::GetDescriptorSize(VkDescriptorType descriptor_type) const {
+    const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties = device_->GetDescriptorBufferProperties();
+    switch (descriptor_type) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER: {
+            return properties.samplerDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: {
+            return properties.combinedImageSamplerDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: {
+            return properties.sampledImageDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: {
+            return properties.storageImageDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: {
+            return properties.inputAttachmentDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: {
+            return properties.uniformBufferDescriptorSize;
+        }
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+            return properties.storageBufferDescriptorSize;
+        }
+        default: {
+            throw std::runtime_error("Failed to get descriptor size, the descriptor type isn't supported with descriptor buffers!");
+        }
+    }
+}
+
+void DescriptorBuffer::WriteDescriptor(const Allocation& allocation, uint32_t binding, uint32_t array_element, const VkDescriptorGetInfoEXT& get_info) {
+    // Array elements of a binding are packed one after the other, starting at the binding's offset.
+    VkDeviceSize binding_offset;
+    _vkGetDescriptorSetLayoutBindingOffsetEXT(device_->GetLogicalDevice(), allocation.layout->GetLayout(), binding, &binding_offset);
+
+    size_t descriptor_size = GetDescriptorSize(get_info.type);
+    _vkGetDescriptorEXT(device_->GetLogicalDevice(), &get_info, descriptor_size, allocation.data + binding_offset + array_element * descriptor_size);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+#include "Command.h"
+#include "Device.h"
+#include "Parameters.h"
+#include "Resources.h"
+
+// Where descriptors go instead of descriptor sets when Device::UsesDescriptorBuffers(). Descriptors are plain
+// memory in a host-visible buffer: writing one is a vkGetDescriptorEXT straight into the mapped buffer, and binding
+// a set just points the pipeline at an offset, so there are no pools, no set allocations and no update calls.
+// The buffer is a ring with a region per frame in flight, and sets are allocated linearly from the current one.
+class DescriptorBuffer {
+public:
+    struct Desc {
+        uint32_t num_frames_in_flight = 2;
+        VkDeviceSize frame_size = 1024 * 1024;
+    };
+
+    // The descriptors of one set. They stay valid until the frame's region comes around again.
+    struct Allocation {
+        std::shared_ptr<DescriptorSetLayout> layout;
+        VkDeviceSize offset;
+        uint8_t* data;
+    };
+
+    DescriptorBuffer(std::shared_ptr<Device> device, Allocator& allocator, const Desc& buffer_desc);
+    ~DescriptorBuffer();
+
+    DescriptorBuffer(const DescriptorBuffer&) = delete;
+    DescriptorBuffer& operator=(const DescriptorBuffer&) = delete;
+
+    // The GPU has to be done with whatever the frame's region was last used for.
+    void BeginFrame(uint32_t frame_index);
+
+    // The layout has to be created while the device uses descriptor buffers.
+    Allocation AllocateDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout);
+
+    // Buffer descriptors point at a device address, so the range has to be given explicitly, VK_WHOLE_SIZE won't do.
+    void WriteBuffer(const Allocation& allocation, uint32_t binding, std::shared_ptr<Buffer> buffer, VkDeviceSize offset, VkDeviceSize range, uint32_t array_element = 0);
+    void WriteImage(const Allocation& allocation, uint32_t binding, std::shared_ptr<ImageView> image_view, VkImageLayout image_layout, uint32_t array_element = 0);
+    void WriteCombinedImageSampler(const Allocation& allocation, uint32_t binding, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler,
+                                   VkImageLayout image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, uint32_t array_element = 0);
+    void WriteSampler(const Allocation& allocation, uint32_t binding, std::shared_ptr<Sampler> sampler, uint32_t array_element = 0);
+
+    // Has to be done once per command buffer, before any of its sets are bound.
+    void Bind(CommandBuffer command_buffer) const;
+    void BindDescriptorSet(CommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set, const Allocation& allocation) const;
+
+private:
+    std::shared_ptr<Device> device_;
+    Desc buffer_desc_;
+
+    std::shared_ptr<Buffer> buffer_;
+    VkDeviceAddress buffer_address_;
+    uint8_t* buffer_data_;
+
+    uint32_t frame_index_;
+    VkDeviceSize frame_offset_;
+
+    size_t GetDescriptorSize(VkDescriptorType descriptor_type) const;
+    void WriteDescriptor(const Allocation& allocation, uint32_t binding, uint32_t array_element, const VkDescriptorGetInfoEXT& get_info);
+};
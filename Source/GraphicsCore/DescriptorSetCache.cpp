@@ -0,0 +1,148 @@
+#include "DescriptorSetCache.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "../CoreUtility/Hash.h"
+
+enum class DescriptorKind {
+    BUFFER,
+    IMAGE,
+    TEXEL_BUFFER,
+};
+
+static DescriptorKind GetDescriptorKind(VkDescriptorType descriptor_type) {
+    switch (descriptor_type) {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: {
+            return DescriptorKind::BUFFER;
+        }
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: {
+            return DescriptorKind::TEXEL_BUFFER;
+        }
+        default: {
+            return DescriptorKind::IMAGE;
+        }
+    }
+}
+
+// Only the members that are actually in use are looked at, since whatever else is in the union
+// (like the padding of VkDescriptorImageInfo) isn't necessarily initialized.
+static uint64_t HashDescriptor(DescriptorKind kind, const DescriptorSetLayout::DescriptorInfo& descriptor, uint64_t hash) {
+    switch (kind) {
+        case DescriptorKind::BUFFER: {
+            hash = HashValue(descriptor.buffer.buffer, hash);
+            hash = HashValue(descriptor.buffer.offset, hash);
+            return HashValue(descriptor.buffer.range, hash);
+        }
+        case DescriptorKind::TEXEL_BUFFER: {
+            return HashValue(descriptor.texel_buffer_view, hash);
+        }
+        default: {
+            hash = HashValue(descriptor.image.sampler, hash);
+            hash = HashValue(descriptor.image.imageView, hash);
+            return HashValue(descriptor.image.imageLayout, hash);
+        }
+    }
+}
+
+static bool IsSameDescriptor(DescriptorKind kind, const DescriptorSetLayout::DescriptorInfo& first, const DescriptorSetLayout::DescriptorInfo& second) {
+    switch (kind) {
+        case DescriptorKind::BUFFER: {
+            return first.buffer.buffer == second.buffer.buffer && first.buffer.offset == second.buffer.offset && first.buffer.range == second.buffer.range;
+        }
+        case DescriptorKind::TEXEL_BUFFER: {
+            return first.texel_buffer_view == second.texel_buffer_view;
+        }
+        default: {
+            return first.image.sampler == second.image.sampler && first.image.imageView == second.image.imageView && first.image.imageLayout == second.image.imageLayout;
+        }
+    }
+}
+
+// Calls the function with the kind of every descriptor of the layout, in the order they are packed in.
+template<typename F> static void ForEachDescriptor(const DescriptorSetLayout& layout, F&& function) {
+    for (const VkDescriptorSetLayoutBinding& binding : layout.GetBindings()) {
+        DescriptorKind kind = GetDescriptorKind(binding.descriptorType);
+        uint32_t descriptor_offset = layout.GetDescriptorOffset(binding.binding);
+        for (uint32_t array_element = 0; array_element < binding.descriptorCount; array_element++) {
+            function(kind, descriptor_offset + array_element);
+        }
+    }
+}
+
+DescriptorSetCache::DescriptorSetCache(std::shared_ptr<Device> device, uint32_t num_frames_in_flight, uint32_t max_unused_frames) :
+    device_{ device },
+    max_unused_frames_{ std::max(max_unused_frames, num_frames_in_flight) },
+    frame_number_{ 0 },
+    descriptor_pool_{ device },
+    num_hits_{ 0 },
+    num_misses_{ 0 }
+{}
+
+void DescriptorSetCache::BeginFrame(uint64_t frame_number) {
+    assert(frame_number >= frame_number_);
+    frame_number_ = frame_number;
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        std::vector<Entry>& entries = it->second;
+        for (auto entry = entries.begin(); entry != entries.end();) {
+            // The resources are only released here, once the GPU is done with the set as well.
+            if (entry->last_used_frame + max_unused_frames_ <= frame_number_) {
+                free_sets_[entry->layout->GetLayout()].push_back(std::move(entry->descriptor_set));
+                entry = entries.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+
+        it = entries.empty() ? entries_.erase(it) : std::next(it);
+    }
+}
+
+std::shared_ptr<DescriptorSet> DescriptorSetCache::GetDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout, const std::vector<DescriptorSetLayout::DescriptorInfo>& descriptors,
+                                                                    const std::vector<std::shared_ptr<void>>& resources) {
+    assert(descriptors.size() == layout->GetNumDescriptors());
+
+    // Layouts come from the device's layout cache, so the handle stands for the bindings.
+    uint64_t hash = HashValue(layout->GetLayout());
+    ForEachDescriptor(*layout, [&](DescriptorKind kind, uint32_t descriptor_index) {
+        hash = HashDescriptor(kind, descriptors[descriptor_index], hash);
+    });
+
+    std::vector<Entry>& entries = entries_[hash];
+    for (Entry& entry : entries) {
+        if (entry.layout->GetLayout() != layout->GetLayout()) {
+            continue;
+        }
+
+        bool is_same = true;
+        ForEachDescriptor(*layout, [&](DescriptorKind kind, uint32_t descriptor_index) {
+            is_same = is_same && IsSameDescriptor(kind, entry.descriptors[descriptor_index], descriptors[descriptor_index]);
+        });
+
+        if (is_same) {
+            entry.last_used_frame = frame_number_;
+            num_hits_++;
+            return entry.descriptor_set;
+        }
+    }
+
+    std::shared_ptr<DescriptorSet> descriptor_set;
+    std::vector<std::shared_ptr<DescriptorSet>>& free_sets = free_sets_[layout->GetLayout()];
+    if (!free_sets.empty()) {
+        descriptor_set = std::move(free_sets.back());
+        free_sets.pop_back();
+    } else {
+        descriptor_set = descriptor_pool_.AllocateDescriptorSet(layout);
+    }
+
+    descriptor_set->Update(descriptors.data());
+    num_misses_++;
+
+    entries.push_back(Entry{layout, descriptors, descriptor_set, resources, frame_number_});
+    return descriptor_set;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Parameters.h"
+
+// Descriptor sets that get the same resources written every frame (e.g. the parameters of a pass) are looked up
+// by their contents instead, so in steady state they are written once and then reused as they are.
+// Sets that haven't been asked for in a while are recycled for different contents, which is only safe
+// once the GPU is done with them, so the age limit has to cover all frames in flight.
+// Only meant to be used from the thread that records the frame.
+class DescriptorSetCache {
+public:
+    DescriptorSetCache(std::shared_ptr<Device> device, uint32_t num_frames_in_flight, uint32_t max_unused_frames = 8);
+    ~DescriptorSetCache() = default;
+
+    DescriptorSetCache(const DescriptorSetCache&) = delete;
+    DescriptorSetCache& operator=(const DescriptorSetCache&) = delete;
+
+    // Once the frame that last used a set is done on the GPU, and it has gone unused for long enough, it is recycled.
+    void BeginFrame(uint64_t frame_number);
+
+    // The descriptors are packed the way DescriptorSetLayout::GetDescriptorOffset() describes. The set is only valid
+    // for the current frame, and has to be asked for again in later frames.
+    // Sets are looked up by the raw handles, so the resources (buffers, image views, samplers...) the descriptors
+    // refer to are kept alive as long as the set is cached. Otherwise a new resource could get the handle of a
+    // destroyed one, and be handed a set that was written for the old one.
+    std::shared_ptr<DescriptorSet> GetDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout, const std::vector<DescriptorSetLayout::DescriptorInfo>& descriptors,
+                                                    const std::vector<std::shared_ptr<void>>& resources);
+
+    inline uint64_t GetNumHits() const {return num_hits_;}
+    inline uint64_t GetNumMisses() const {return num_misses_;}
+
+private:
+    struct Entry {
+        std::shared_ptr<DescriptorSetLayout> layout;
+        std::vector<DescriptorSetLayout::DescriptorInfo> descriptors;
+        std::shared_ptr<DescriptorSet> descriptor_set;
+        std::vector<std::shared_ptr<void>> resources;
+        uint64_t last_used_frame;
+    };
+
+    std::shared_ptr<Device> device_;
+    uint32_t max_unused_frames_;
+    uint64_t frame_number_;
+
+    DescriptorPool descriptor_pool_;
+    std::unordered_map<uint64_t, std::vector<Entry>> entries_;
+    // Sets that aged out, ready to be written with something else.
+    std::unordered_map<VkDescriptorSetLayout, std::vector<std::shared_ptr<DescriptorSet>>> free_sets_;
+
+    uint64_t num_hits_;
+    uint64_t num_misses_;
+};
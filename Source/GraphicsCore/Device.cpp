@@ -1,34 +1,61 @@
 #include "Device.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <functional>
 #include <map>
 #include <optional>
 
+#include "LayoutCache.h"
+#include "PipelineCache.h"
 #include "Utility.h"
 
-Device::Device(std::shared_ptr<Instance> instance, const VkSurfaceKHR surface) :
+Device::Device(std::shared_ptr<Instance> instance, const VkSurfaceKHR surface, DescriptorModel descriptor_model, ShaderModel shader_model) :
     instance_{ instance },
     logical_device_{ VK_NULL_HANDLE },
     physical_device_{ VK_NULL_HANDLE },
-    device_features_{ }
+    device_features_{ },
+    is_bindless_supported_{ false },
+    uses_descriptor_buffers_{ false },
+    descriptor_buffer_properties_{ },
+    is_graphics_pipeline_library_supported_{ false },
+    uses_shader_objects_{ false }
 {
     // Request device extensions and features
-    requested_device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    if (surface != VK_NULL_HANDLE) {
+        requested_device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     requested_device_extensions_.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
     requested_device_extensions_.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    if (descriptor_model == DESCRIPTOR_BUFFERS) {
+        optional_device_extensions_.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+    }
+    optional_device_extensions_.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    optional_device_extensions_.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    if (shader_model == SHADER_OBJECTS) {
+        optional_device_extensions_.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+    }
 
     device_features_.samplerAnisotropy = VK_TRUE;
 
     SelectPhysicalDevice();
     RequestDeviceExtensions();
+    QueryDescriptorIndexingSupport();
+    QueryDescriptorBufferSupport(descriptor_model);
+    QueryGraphicsPipelineLibrarySupport();
+    QueryShaderObjectSupport(shader_model);
     FindQueueFamilies(surface);
     CreateLogicalDeviceAndQueues();
+
+    layout_cache_ = std::make_unique<LayoutCache>(*this);
+    pipeline_cache_ = std::make_unique<PipelineCache>(*this, PipelineCache::GetDefaultPath());
 }
 
 Device::~Device() {
     if (logical_device_ != VK_NULL_HANDLE) {
         vkDeviceWaitIdle(logical_device_);
+        // Saves the cache, which needs the device.
+        pipeline_cache_.reset();
         vkDestroyDevice(logical_device_, nullptr);
         logical_device_ = VK_NULL_HANDLE;
     }
@@ -95,12 +122,147 @@ void Device::RequestDeviceExtensions() {
         }
     }
 
+    for (const std::string& optional_extension : optional_device_extensions_) {
+        for (const VkExtensionProperties& available_extension : available_extensions) {
+            if (optional_extension == available_extension.extensionName) {
+                enabled_device_extensions_.emplace_back(optional_extension.c_str());
+                break;
+            }
+        }
+    }
+
     LOG(LogVulkan, Logger::SeverityLevel::INFO, "Enabled Device Extensions:");
     for (const char* enabled_extension : enabled_device_extensions_) {
         LOG(LogVulkan, Logger::SeverityLevel::INFO, "\t{0}", enabled_extension);
     }
 }
 
+void Device::QueryDescriptorIndexingSupport() {
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &descriptor_indexing_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+    // Bindless is optional, devices without it just can't use a BindlessHeap.
+    is_bindless_supported_ = descriptor_indexing_features.runtimeDescriptorArray &&
+                             descriptor_indexing_features.descriptorBindingPartiallyBound &&
+                             descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending &&
+                             descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind &&
+                             descriptor_indexing_features.descriptorBindingStorageImageUpdateAfterBind &&
+                             descriptor_indexing_features.descriptorBindingStorageBufferUpdateAfterBind &&
+                             descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing &&
+                             descriptor_indexing_features.shaderStorageImageArrayNonUniformIndexing &&
+                             descriptor_indexing_features.shaderStorageBufferArrayNonUniformIndexing;
+
+    LOG(LogVulkan, Logger::SeverityLevel::INFO, "Bindless descriptors supported: {0}", is_bindless_supported_);
+}
+
+void Device::QueryDescriptorBufferSupport(DescriptorModel descriptor_model) {
+    if (descriptor_model != DESCRIPTOR_BUFFERS || !IsExtensionEnabled(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+        return;
+    }
+
+    VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+    };
+
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+        .pNext = &buffer_device_address_features,
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &descriptor_buffer_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+    uses_descriptor_buffers_ = descriptor_buffer_features.descriptorBuffer && buffer_device_address_features.bufferDeviceAddress;
+
+    if (uses_descriptor_buffers_) {
+        descriptor_buffer_properties_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &descriptor_buffer_properties_,
+        };
+
+        vkGetPhysicalDeviceProperties2(physical_device_, &properties);
+    }
+
+    LOG(LogVulkan, Logger::SeverityLevel::INFO, "Using descriptor buffers: {0}", uses_descriptor_buffers_);
+}
+
+void Device::QueryGraphicsPipelineLibrarySupport() {
+    if (!IsExtensionEnabled(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) || !IsExtensionEnabled(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+        return;
+    }
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &graphics_pipeline_library_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphics_pipeline_library_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT,
+    };
+
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &graphics_pipeline_library_properties,
+    };
+
+    vkGetPhysicalDeviceProperties2(physical_device_, &properties);
+
+    // Some drivers implement the extension by compiling the whole pipeline when the libraries are linked,
+    // which is no faster than creating it directly, so the libraries are only used where linking is fast.
+    is_graphics_pipeline_library_supported_ = graphics_pipeline_library_features.graphicsPipelineLibrary &&
+                                              graphics_pipeline_library_properties.graphicsPipelineLibraryFastLinking;
+
+    LOG(LogVulkan, Logger::SeverityLevel::INFO, "Graphics pipeline libraries supported: {0}", is_graphics_pipeline_library_supported_);
+}
+
+void Device::QueryShaderObjectSupport(ShaderModel shader_model) {
+    if (shader_model != SHADER_OBJECTS || !IsExtensionEnabled(VK_EXT_SHADER_OBJECT_EXTENSION_NAME)) {
+        return;
+    }
+
+    VkPhysicalDeviceShaderObjectFeaturesEXT shader_object_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT,
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &shader_object_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+    uses_shader_objects_ = shader_object_features.shaderObject;
+
+    LOG(LogVulkan, Logger::SeverityLevel::INFO, "Using shader objects: {0}", uses_shader_objects_);
+}
+
+bool Device::IsExtensionEnabled(const std::string& extension_name) const {
+    for (const char* enabled_extension : enabled_device_extensions_) {
+        if (extension_name == enabled_extension) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
     uint32_t num_queue_families = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &num_queue_families, nullptr);
@@ -121,11 +283,14 @@ void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
             return result;
         };
 
-    // Prefer a queue family has supports both graphics and present queues
+    // Prefer a queue family has supports both graphics and present queues.
+    // Headless devices never present, so any graphics queue family will do.
     auto supports_graphics_present =
         [&](const VkQueueFamilyProperties& candidate_queue_family, uint32_t queue_family_index) {
-            VkBool32 supports_present = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device_, queue_family_index, surface, &supports_present);
+            VkBool32 supports_present = (surface == VK_NULL_HANDLE);
+            if (!supports_present) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(physical_device_, queue_family_index, surface, &supports_present);
+            }
             return ((candidate_queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) && supports_present;
         };
 
@@ -133,6 +298,8 @@ void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
     if (graphics_present_family.has_value()) {
         queues_[QueueType::GRAPHICS].queue_family = graphics_present_family.value();
         queues_[QueueType::PRESENT].queue_family = graphics_present_family.value();
+    } else {
+        throw std::runtime_error("No suitable graphics queue family found!");
     }
 
     // Prefer a dedicated compute queue family
@@ -153,7 +320,7 @@ void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
 
         auto compute_family = search(supports_compute);
         if (compute_family.has_value()) {
-            queues_[QueueType::COMPUTE].queue_family = compute_family.has_value();
+            queues_[QueueType::COMPUTE].queue_family = compute_family.value();
         } else {
             throw std::runtime_error("No suitable compute queue family found!");
         }
@@ -169,7 +336,7 @@ void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
 
     auto dedicated_transfer_family = search(supports_dedicated_transfer);
     if (dedicated_transfer_family.has_value()) {
-        queues_[QueueType::TRANSFER].queue_family = dedicated_transfer_family.has_value();
+        queues_[QueueType::TRANSFER].queue_family = dedicated_transfer_family.value();
     } else {
         auto supports_transfer =
             [](const VkQueueFamilyProperties& candidate_queue_family, uint32_t queue_family_index) {
@@ -185,10 +352,12 @@ void Device::FindQueueFamilies(const VkSurfaceKHR surface) {
     }
 
     // Once all queues are found, check what their queues should be in their respective families.
+    // Families that don't have enough queues for every type that uses them share their last queue.
     std::vector<uint32_t> queue_family_counts(num_queue_families, 0);
     for (int queue_type = 0; queue_type < QueueType::MAX_QUEUE_TYPES; queue_type++) {
         Queue& queue = queues_[static_cast<uint32_t>(queue_type)];
-        queue.queue_index = queue_family_counts[queue.queue_family]++;
+        uint32_t max_queue_index = available_queue_families[queue.queue_family].queueCount - 1;
+        queue.queue_index = std::min(queue_family_counts[queue.queue_family]++, max_queue_index);
         queue.queue_priority = 1.0f;
     }
 }
@@ -205,8 +374,10 @@ void Device::CreateLogicalDeviceAndQueues() {
     for (int queue_type = 0; queue_type < QueueType::MAX_QUEUE_TYPES; queue_type++) {
         const Queue& queue = queues_[static_cast<uint32_t>(queue_type)];
         UniqueQueueFamily& unique_queue_family = unique_queue_families[queue.queue_family];
-        unique_queue_family.queue_count++;
-        unique_queue_family.queue_priorities.push_back(queue.queue_priority);
+        if (queue.queue_index >= unique_queue_family.queue_count) {
+            unique_queue_family.queue_count = queue.queue_index + 1;
+            unique_queue_family.queue_priorities.resize(unique_queue_family.queue_count, queue.queue_priority);
+        }
     }
 
     std::vector<VkDeviceQueueCreateInfo> queue_infos;
@@ -239,7 +410,66 @@ void Device::CreateLogicalDeviceAndQueues() {
         .dynamicRendering = VK_TRUE,
     };
 
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .timelineSemaphore = VK_TRUE,
+    };
+
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+        .shaderStorageBufferArrayNonUniformIndexing = VK_TRUE,
+        .shaderStorageImageArrayNonUniformIndexing = VK_TRUE,
+        .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+        .descriptorBindingStorageImageUpdateAfterBind = VK_TRUE,
+        .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+        .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+        .descriptorBindingPartiallyBound = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+    };
+
+    VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+        .bufferDeviceAddress = VK_TRUE,
+    };
+
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+        .pNext = &buffer_device_address_features,
+        .descriptorBuffer = VK_TRUE,
+    };
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+        .graphicsPipelineLibrary = VK_TRUE,
+    };
+
+    VkPhysicalDeviceShaderObjectFeaturesEXT shader_object_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT,
+        .shaderObject = VK_TRUE,
+    };
+
     // TODO: handle this pNext chain better
+    if (is_bindless_supported_) {
+        descriptor_indexing_features.pNext = timeline_semaphore_features.pNext;
+        timeline_semaphore_features.pNext = &descriptor_indexing_features;
+    }
+
+    if (uses_descriptor_buffers_) {
+        buffer_device_address_features.pNext = timeline_semaphore_features.pNext;
+        timeline_semaphore_features.pNext = &descriptor_buffer_features;
+    }
+
+    if (is_graphics_pipeline_library_supported_) {
+        graphics_pipeline_library_features.pNext = timeline_semaphore_features.pNext;
+        timeline_semaphore_features.pNext = &graphics_pipeline_library_features;
+    }
+
+    if (uses_shader_objects_) {
+        shader_object_features.pNext = timeline_semaphore_features.pNext;
+        timeline_semaphore_features.pNext = &shader_object_features;
+    }
+    sync_features.pNext = &timeline_semaphore_features;
     dynamic_rendering_features.pNext = &sync_features;
     device_info.pNext = &dynamic_rendering_features;
 
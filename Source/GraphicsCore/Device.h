@@ -9,9 +9,30 @@
 
 #include "Instance.h"
 
-class Device {
+class LayoutCache;
+class PipelineCache;
+
+// Devices are always owned by a shared_ptr, which the objects they create (like cached layouts) hold on to.
+class Device : public std::enable_shared_from_this<Device> {
 public:
-    Device(std::shared_ptr<Instance> instance, const VkSurfaceKHR surface);
+    // How shaders get their descriptors. Descriptor buffers are only used if the device supports them,
+    // and it falls back to descriptor sets otherwise, see UsesDescriptorBuffers().
+    enum DescriptorModel {
+        DESCRIPTOR_SETS,
+        DESCRIPTOR_BUFFERS,
+    };
+
+    // How shaders are bound. With shader objects, shaders are bound on their own and all the state a pipeline
+    // would bake in is set while recording, see DynamicStateTracker. Only used if the device supports them,
+    // and it falls back to pipelines otherwise, see UsesShaderObjects().
+    enum ShaderModel {
+        PIPELINES,
+        SHADER_OBJECTS,
+    };
+
+    // Without a surface, the device is headless: queues are picked purely on their capabilities,
+    // and the present queue is just the graphics queue.
+    Device(std::shared_ptr<Instance> instance, const VkSurfaceKHR surface, DescriptorModel descriptor_model = DESCRIPTOR_SETS, ShaderModel shader_model = PIPELINES);
     ~Device();
 
     enum QueueType {
@@ -36,6 +57,27 @@ public:
         return queues_[queue_type];
     }
 
+    inline LayoutCache& GetLayoutCache() const {return *layout_cache_;}
+    // Shared by all pipelines created on the device, and kept on disk between runs.
+    inline PipelineCache& GetPipelineCache() const {return *pipeline_cache_;}
+
+    // Whether the descriptor indexing features a BindlessHeap needs are enabled.
+    inline bool IsBindlessSupported() const {return is_bindless_supported_;}
+
+    // With descriptor buffers, descriptors are written into a DescriptorBuffer instead of descriptor sets,
+    // and descriptor set layouts and pipelines are created for that.
+    inline bool UsesDescriptorBuffers() const {return uses_descriptor_buffers_;}
+    inline const VkPhysicalDeviceDescriptorBufferPropertiesEXT& GetDescriptorBufferProperties() const {return descriptor_buffer_properties_;}
+
+    // Whether graphics pipelines can be linked from separately compiled parts, and linking is fast,
+    // see GraphicsPipelineLibrary.
+    inline bool IsGraphicsPipelineLibrarySupported() const {return is_graphics_pipeline_library_supported_;}
+
+    // With shader objects, every Shader also has a VkShaderEXT to bind instead of a pipeline.
+    inline bool UsesShaderObjects() const {return uses_shader_objects_;}
+
+    bool IsExtensionEnabled(const std::string& extension_name) const;
+
     inline void WaitIdle() const {
         assert(logical_device_ != VK_NULL_HANDLE);
         vkDeviceWaitIdle(logical_device_);
@@ -50,11 +92,25 @@ private:
     Queue queues_[QueueType::MAX_QUEUE_TYPES];
 
     VkPhysicalDeviceFeatures device_features_;
+    bool is_bindless_supported_;
+    bool uses_descriptor_buffers_;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_properties_;
+    bool is_graphics_pipeline_library_supported_;
+    bool uses_shader_objects_;
     std::vector<std::string> requested_device_extensions_;
+    // Only enabled if the device has them.
+    std::vector<std::string> optional_device_extensions_;
     std::vector<const char*> enabled_device_extensions_;
 
+    std::unique_ptr<LayoutCache> layout_cache_;
+    std::unique_ptr<PipelineCache> pipeline_cache_;
+
     void SelectPhysicalDevice();
     void RequestDeviceExtensions();
+    void QueryDescriptorIndexingSupport();
+    void QueryDescriptorBufferSupport(DescriptorModel descriptor_model);
+    void QueryGraphicsPipelineLibrarySupport();
+    void QueryShaderObjectSupport(ShaderModel shader_model);
     void FindQueueFamilies(const VkSurfaceKHR surface);
     void CreateLogicalDeviceAndQueues();
 };
@@ -0,0 +1,238 @@
+#include "DynamicState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "LayoutCache.h"
+#include "Utility.h"
+
+// Shader objects are created with their own set layouts, and descriptor sets can only be bound for both of them
+// with a layout that is compatible with each. That is the case if one shader's sets are the start of the other's,
+// e.g. for the shaders of a program, which are reflected together and get the same sets.
+static std::shared_ptr<PipelineLayout> GetSharedLayout(std::shared_ptr<Device> device, const GraphicsPipeline::ShaderStages& shaders) {
+    const auto& vertex_layouts = shaders.vertex_shader->GetParameterLayouts();
+    const auto& fragment_layouts = shaders.fragment_shader->GetParameterLayouts();
+    const auto& shorter_layouts = (vertex_layouts.size() < fragment_layouts.size()) ? vertex_layouts : fragment_layouts;
+    const auto& longer_layouts = (vertex_layouts.size() < fragment_layouts.size()) ? fragment_layouts : vertex_layouts;
+
+    // Layouts come from the device's layout cache, so identical bindings mean the same layout.
+    if (!std::equal(shorter_layouts.begin(), shorter_layouts.end(), longer_layouts.begin())) {
+        throw std::runtime_error("Failed to bind shaders, the vertex and fragment shader have different descriptor set layouts!");
+    }
+
+    return device->GetLayoutCache().GetPipelineLayout(longer_layouts);
+}
+
+DynamicStateTracker::DynamicStateTracker(std::shared_ptr<Device> device) :
+    device_{ device },
+    is_fixed_state_set_{ false },
+    num_commands_{ 0 },
+    num_skipped_commands_{ 0 }
+{
+    if (!device_->UsesShaderObjects()) {
+        throw std::runtime_error("Failed to create dynamic state tracker, the device doesn't use shader objects!");
+    }
+}
+
+void DynamicStateTracker::Reset() {
+    vertex_shader_.reset();
+    fragment_shader_.reset();
+    compute_shader_.reset();
+    graphics_layout_ = nullptr;
+    compute_layout_ = nullptr;
+
+    is_fixed_state_set_ = false;
+    vertex_input_.reset();
+    topology_.reset();
+    polygon_mode_.reset();
+    cull_mode_.reset();
+    front_face_.reset();
+    sample_count_.reset();
+    depth_test_enable_.reset();
+    depth_write_enable_.reset();
+    depth_compare_op_.reset();
+    blend_.reset();
+    viewport_.reset();
+    scissor_.reset();
+}
+
+void DynamicStateTracker::BindGraphics(CommandBuffer& command_buffer, const GraphicsPipeline::ShaderStages& shaders, const GraphicsPipeline::State& state, uint32_t num_color_attachments) {
+    // The layout is only looked up when the shaders change, which is also the only time it can.
+    if (graphics_layout_ == nullptr || vertex_shader_ != shaders.vertex_shader || fragment_shader_ != shaders.fragment_shader) {
+        graphics_layout_ = GetSharedLayout(device_, shaders);
+    }
+
+    command_buffer.Record([&](VkCommandBuffer command) {
+        Set(vertex_shader_, shaders.vertex_shader, [&]() {
+            VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+            VkShaderEXT shader_object = shaders.vertex_shader->GetShaderObject();
+            _vkCmdBindShadersEXT(command, 1, &stage, &shader_object);
+        });
+        Set(fragment_shader_, shaders.fragment_shader, [&]() {
+            VkShaderStageFlagBits stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            VkShaderEXT shader_object = shaders.fragment_shader->GetShaderObject();
+            _vkCmdBindShadersEXT(command, 1, &stage, &shader_object);
+        });
+
+        SetFixedState(command);
+
+        VertexInputState vertex_input = {
+            .vertex_shader = shaders.vertex_shader,
+            .vertex_streams = state.vertex_streams,
+        };
+        Set(vertex_input_, vertex_input, [&]() {SetVertexInput(command, vertex_input);});
+
+        Set(topology_, state.topology, [&]() {_vkCmdSetPrimitiveTopologyEXT(command, state.topology);});
+        Set(polygon_mode_, state.polygon_mode, [&]() {_vkCmdSetPolygonModeEXT(command, state.polygon_mode);});
+        Set(cull_mode_, state.cull_mode, [&]() {_vkCmdSetCullModeEXT(command, state.cull_mode);});
+        Set(front_face_, state.front_face, [&]() {_vkCmdSetFrontFaceEXT(command, state.front_face);});
+        Set(sample_count_, state.sample_count, [&]() {
+            VkSampleMask sample_mask = ~0u;
+            _vkCmdSetRasterizationSamplesEXT(command, state.sample_count);
+            _vkCmdSetSampleMaskEXT(command, state.sample_count, &sample_mask);
+        });
+
+        Set(depth_test_enable_, state.depth_test_enable, [&]() {_vkCmdSetDepthTestEnableEXT(command, state.depth_test_enable);});
+        Set(depth_write_enable_, state.depth_write_enable, [&]() {_vkCmdSetDepthWriteEnableEXT(command, state.depth_write_enable);});
+        Set(depth_compare_op_, state.depth_compare_op, [&]() {_vkCmdSetDepthCompareOpEXT(command, state.depth_compare_op);});
+
+        BlendState blend = {
+            .num_color_attachments = num_color_attachments,
+            .blend_enable = state.blend_enable,
+            .src_color_blend_factor = state.src_color_blend_factor,
+            .dst_color_blend_factor = state.dst_color_blend_factor,
+            .color_blend_op = state.color_blend_op,
+            .src_alpha_blend_factor = state.src_alpha_blend_factor,
+            .dst_alpha_blend_factor = state.dst_alpha_blend_factor,
+            .alpha_blend_op = state.alpha_blend_op,
+            .color_write_mask = state.color_write_mask,
+        };
+        Set(blend_, blend, [&]() {SetBlendState(command, blend);});
+    });
+}
+
+void DynamicStateTracker::BindCompute(CommandBuffer& command_buffer, std::shared_ptr<Shader> compute_shader) {
+    command_buffer.Record([&](VkCommandBuffer command) {
+        Set(compute_shader_, compute_shader, [&]() {
+            VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            VkShaderEXT shader_object = compute_shader->GetShaderObject();
+            _vkCmdBindShadersEXT(command, 1, &stage, &shader_object);
+            compute_layout_ = device_->GetLayoutCache().GetPipelineLayout(compute_shader->GetParameterLayouts());
+        });
+    });
+}
+
+void DynamicStateTracker::SetViewport(CommandBuffer& command_buffer, const VkViewport& viewport) {
+    // Plain structs without padding, so they can be compared bytewise.
+    if (viewport_.has_value() && std::memcmp(&*viewport_, &viewport, sizeof(VkViewport)) == 0) {
+        num_skipped_commands_++;
+        return;
+    }
+
+    viewport_ = viewport;
+    command_buffer.Record([&](VkCommandBuffer command) {
+        _vkCmdSetViewportWithCountEXT(command, 1, &viewport);
+    });
+    num_commands_++;
+}
+
+void DynamicStateTracker::SetScissor(CommandBuffer& command_buffer, const VkRect2D& scissor) {
+    if (scissor_.has_value() && std::memcmp(&*scissor_, &scissor, sizeof(VkRect2D)) == 0) {
+        num_skipped_commands_++;
+        return;
+    }
+
+    scissor_ = scissor;
+    command_buffer.Record([&](VkCommandBuffer command) {
+        _vkCmdSetScissorWithCountEXT(command, 1, &scissor);
+    });
+    num_commands_++;
+}
+
+void DynamicStateTracker::BindDescriptorSet(CommandBuffer& command_buffer, VkPipelineBindPoint bind_point, uint32_t set, std::shared_ptr<DescriptorSet> descriptor_set) {
+    std::shared_ptr<PipelineLayout> layout = GetLayout(bind_point);
+    if (layout == nullptr) {
+        throw std::runtime_error("Failed to bind descriptor set, no shaders are bound!");
+    }
+
+    command_buffer.Record([&](VkCommandBuffer command) {
+        VkDescriptorSet descriptors = descriptor_set->GetDescriptorSet();
+        vkCmdBindDescriptorSets(command, bind_point, layout->GetLayout(), set, 1, &descriptors, 0, nullptr);
+    });
+}
+
+std::shared_ptr<PipelineLayout> DynamicStateTracker::GetLayout(VkPipelineBindPoint bind_point) const {
+    return (bind_point == VK_PIPELINE_BIND_POINT_COMPUTE) ? compute_layout_ : graphics_layout_;
+}
+
+void DynamicStateTracker::SetFixedState(VkCommandBuffer command) {
+    if (is_fixed_state_set_) {
+        return;
+    }
+
+    // Everything else that has to be set before drawing with shader objects, given the features the device enables.
+    _vkCmdSetPrimitiveRestartEnableEXT(command, VK_FALSE);
+    _vkCmdSetRasterizerDiscardEnableEXT(command, VK_FALSE);
+    _vkCmdSetDepthBiasEnableEXT(command, VK_FALSE);
+    _vkCmdSetAlphaToCoverageEnableEXT(command, VK_FALSE);
+    _vkCmdSetDepthBoundsTestEnableEXT(command, VK_FALSE);
+    _vkCmdSetStencilTestEnableEXT(command, VK_FALSE);
+    vkCmdSetLineWidth(command, 1.0f);
+    num_commands_ += 7;
+
+    is_fixed_state_set_ = true;
+}
+
+void DynamicStateTracker::SetVertexInput(VkCommandBuffer command, const VertexInputState& vertex_input) {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    GraphicsPipeline::GetVertexInputDescriptions(vertex_input.vertex_shader->GetVertexInputs(), vertex_input.vertex_streams, bindings, attributes);
+
+    std::vector<VkVertexInputBindingDescription2EXT> dynamic_bindings;
+    for (const VkVertexInputBindingDescription& binding : bindings) {
+        dynamic_bindings.push_back({
+            .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+            .binding = binding.binding,
+            .stride = binding.stride,
+            .inputRate = binding.inputRate,
+            .divisor = 1,
+        });
+    }
+
+    std::vector<VkVertexInputAttributeDescription2EXT> dynamic_attributes;
+    for (const VkVertexInputAttributeDescription& attribute : attributes) {
+        dynamic_attributes.push_back({
+            .sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT,
+            .location = attribute.location,
+            .binding = attribute.binding,
+            .format = attribute.format,
+            .offset = attribute.offset,
+        });
+    }
+
+    _vkCmdSetVertexInputEXT(command, static_cast<uint32_t>(dynamic_bindings.size()), dynamic_bindings.data(),
+                            static_cast<uint32_t>(dynamic_attributes.size()), dynamic_attributes.data());
+}
+
+void DynamicStateTracker::SetBlendState(VkCommandBuffer command, const BlendState& blend) {
+    if (blend.num_color_attachments == 0) {
+        return;
+    }
+
+    // The same blending for every color attachment, like GraphicsPipeline.
+    std::vector<VkBool32> blend_enables(blend.num_color_attachments, blend.blend_enable);
+    std::vector<VkColorBlendEquationEXT> blend_equations(blend.num_color_attachments, VkColorBlendEquationEXT{
+        .srcColorBlendFactor = blend.src_color_blend_factor,
+        .dstColorBlendFactor = blend.dst_color_blend_factor,
+        .colorBlendOp = blend.color_blend_op,
+        .srcAlphaBlendFactor = blend.src_alpha_blend_factor,
+        .dstAlphaBlendFactor = blend.dst_alpha_blend_factor,
+        .alphaBlendOp = blend.alpha_blend_op,
+    });
+    std::vector<VkColorComponentFlags> color_write_masks(blend.num_color_attachments, blend.color_write_mask);
+
+    _vkCmdSetColorBlendEnableEXT(command, 0, blend.num_color_attachments, blend_enables.data());
+    _vkCmdSetColorBlendEquationEXT(command, 0, blend.num_color_attachments, blend_equations.data());
+    _vkCmdSetColorWriteMaskEXT(command, 0, blend.num_color_attachments, color_write_masks.data());
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Command.h"
+#include "Device.h"
+#include "Parameters.h"
+#include "Pipeline.h"
+#include "Shader.h"
+
+// The state of a command buffer that draws with shader objects, where everything a pipeline would bake in is set
+// while recording. It remembers what was set last and only records what changed, so draws that mostly share their
+// state (like the many small draws of tooling renderers) only cost a few commands, and no pipeline has to exist
+// for any combination of shaders and state.
+// A command buffer starts out without any state, so every command buffer (including secondary ones) needs a
+// tracker of its own. Anything that changes the state behind the tracker's back, like binding a pipeline,
+// has to be followed by a Reset().
+class DynamicStateTracker {
+public:
+    DynamicStateTracker(std::shared_ptr<Device> device);
+    ~DynamicStateTracker() = default;
+
+    // Forgets all state, so everything is recorded again by the next bind.
+    void Reset();
+
+    // Stands in for binding a graphics pipeline created from the same shaders and state. Blending is set for as many
+    // color attachments as the current rendering has. Unlike pipelines, the sets of the two shaders aren't merged,
+    // one shader's set layouts have to be the start of the other's (like for the shaders of a program).
+    void BindGraphics(CommandBuffer& command_buffer, const GraphicsPipeline::ShaderStages& shaders, const GraphicsPipeline::State& state, uint32_t num_color_attachments);
+    void BindCompute(CommandBuffer& command_buffer, std::shared_ptr<Shader> compute_shader);
+
+    void SetViewport(CommandBuffer& command_buffer, const VkViewport& viewport);
+    void SetScissor(CommandBuffer& command_buffer, const VkRect2D& scissor);
+
+    // Descriptor sets are bound with the layout of the shaders bound last for the bind point.
+    void BindDescriptorSet(CommandBuffer& command_buffer, VkPipelineBindPoint bind_point, uint32_t set, std::shared_ptr<DescriptorSet> descriptor_set);
+    std::shared_ptr<PipelineLayout> GetLayout(VkPipelineBindPoint bind_point) const;
+
+    // How many state commands were recorded, and how many were left out because the state was already set.
+    inline uint64_t GetNumCommands() const {return num_commands_;}
+    inline uint64_t GetNumSkippedCommands() const {return num_skipped_commands_;}
+
+private:
+    struct VertexInputState {
+        std::shared_ptr<Shader> vertex_shader;
+        std::vector<GraphicsPipeline::VertexStream> vertex_streams;
+
+        bool operator==(const VertexInputState& other) const = default;
+    };
+
+    struct BlendState {
+        uint32_t num_color_attachments;
+        VkBool32 blend_enable;
+        VkBlendFactor src_color_blend_factor;
+        VkBlendFactor dst_color_blend_factor;
+        VkBlendOp color_blend_op;
+        VkBlendFactor src_alpha_blend_factor;
+        VkBlendFactor dst_alpha_blend_factor;
+        VkBlendOp alpha_blend_op;
+        VkColorComponentFlags color_write_mask;
+
+        bool operator==(const BlendState& other) const = default;
+    };
+
+    std::shared_ptr<Device> device_;
+
+    // Shaders are kept alive while they are bound, so a handle can't be reused for another shader.
+    std::optional<std::shared_ptr<Shader>> vertex_shader_;
+    std::optional<std::shared_ptr<Shader>> fragment_shader_;
+    std::optional<std::shared_ptr<Shader>> compute_shader_;
+    std::shared_ptr<PipelineLayout> graphics_layout_;
+    std::shared_ptr<PipelineLayout> compute_layout_;
+
+    // State that isn't part of GraphicsPipeline::State is always the same, and only set once.
+    bool is_fixed_state_set_;
+    std::optional<VertexInputState> vertex_input_;
+    std::optional<VkPrimitiveTopology> topology_;
+    std::optional<VkPolygonMode> polygon_mode_;
+    std::optional<VkCullModeFlags> cull_mode_;
+    std::optional<VkFrontFace> front_face_;
+    std::optional<VkSampleCountFlagBits> sample_count_;
+    std::optional<VkBool32> depth_test_enable_;
+    std::optional<VkBool32> depth_write_enable_;
+    std::optional<VkCompareOp> depth_compare_op_;
+    std::optional<BlendState> blend_;
+    std::optional<VkViewport> viewport_;
+    std::optional<VkRect2D> scissor_;
+
+    uint64_t num_commands_;
+    uint64_t num_skipped_commands_;
+
+    // Records the command, unless the value is what was set last.
+    template<typename T, typename F> void Set(std::optional<T>& current, const T& value, F set_command) {
+        if (current.has_value() && *current == value) {
+            num_skipped_commands_++;
+            return;
+        }
+        current = value;
+        set_command();
+        num_commands_++;
+    }
+
+    void SetFixedState(VkCommandBuffer command);
+    void SetVertexInput(VkCommandBuffer command, const VertexInputState& vertex_input);
+    void SetBlendState(VkCommandBuffer command, const BlendState& blend);
+};
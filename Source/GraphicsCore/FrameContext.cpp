@@ -0,0 +1,109 @@
+#include "FrameContext.h"
+
+#include <cassert>
+#include <stdexcept>
+
+FrameContext::FrameContext(std::shared_ptr<Device> device, Allocator& allocator, const Desc& frame_desc) :
+    device_{ device },
+    frame_desc_{ frame_desc },
+    frame_index_{ 0 },
+    frame_number_{ 0 }
+{
+    assert(frame_desc_.num_frames_in_flight > 0);
+    CreateFrames(allocator);
+
+    // Present isn't a queue that work gets recorded for.
+    for (uint32_t queue_type = 0; queue_type < Device::QueueType::MAX_QUEUE_TYPES; queue_type++) {
+        if (queue_type == Device::QueueType::PRESENT) {
+            continue;
+        }
+
+        command_rings_[queue_type] = std::make_unique<CommandPoolRing>(device_, static_cast<Device::QueueType>(queue_type),
+                                                                       frame_desc_.num_frames_in_flight, frame_desc_.num_threads);
+    }
+
+    descriptor_set_cache_ = std::make_unique<DescriptorSetCache>(device_, frame_desc_.num_frames_in_flight);
+
+    if (device_->UsesDescriptorBuffers()) {
+        descriptor_buffer_ = std::make_unique<DescriptorBuffer>(device_, allocator, DescriptorBuffer::Desc{
+            .num_frames_in_flight = frame_desc_.num_frames_in_flight,
+            .frame_size = frame_desc_.descriptor_buffer_size,
+        });
+    }
+}
+
+FrameContext::~FrameContext() {
+    device_->WaitIdle();
+
+    for (Frame& frame : frames_) {
+        frame.upload_buffer->UnmapFromCPU();
+    }
+}
+
+void FrameContext::BeginFrame() {
+    // Frame numbers start at 1, so 0 can mean "never".
+    frame_number_++;
+    frame_index_ = static_cast<uint32_t>(frame_number_ % frame_desc_.num_frames_in_flight);
+
+    Frame& frame = frames_[frame_index_];
+    frame.fence->Wait(UINT64_MAX);
+    frame.fence->Reset();
+
+    for (std::unique_ptr<CommandPoolRing>& command_ring : command_rings_) {
+        if (command_ring != nullptr) {
+            command_ring->BeginFrame(frame_index_);
+        }
+    }
+
+    frame.upload_offset = 0;
+    frame.descriptor_pool->Reset();
+    descriptor_set_cache_->BeginFrame(frame_number_);
+    if (descriptor_buffer_ != nullptr) {
+        descriptor_buffer_->BeginFrame(frame_index_);
+    }
+}
+
+CommandBuffer FrameContext::AllocateCommandBuffer(Device::QueueType queue_type, uint32_t thread_index) {
+    assert(command_rings_[queue_type] != nullptr);
+    return command_rings_[queue_type]->AllocateCommandBuffer(thread_index);
+}
+
+FrameContext::UploadAllocation FrameContext::AllocateUpload(VkDeviceSize size, VkDeviceSize alignment) {
+    Frame& frame = frames_[frame_index_];
+
+    VkDeviceSize offset = (frame.upload_offset + alignment - 1) / alignment * alignment;
+    if (offset + size > frame_desc_.upload_buffer_size) {
+        throw std::runtime_error("Failed to allocate upload memory, the frame's upload buffer is full!");
+    }
+    frame.upload_offset = offset + size;
+
+    return UploadAllocation{frame.upload_buffer, offset, frame.upload_data + offset};
+}
+
+std::shared_ptr<DescriptorSet> FrameContext::AllocateTransientDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout) {
+    return frames_[frame_index_].descriptor_pool->AllocateDescriptorSet(layout);
+}
+
+void FrameContext::CreateFrames(Allocator& allocator) {
+    frames_.resize(frame_desc_.num_frames_in_flight);
+    for (Frame& frame : frames_) {
+        // Fences start signaled, since there is nothing to wait for the first time a slot is used.
+        frame.fence = std::make_unique<Fence>(device_, true);
+        frame.image_available_semaphore = std::make_unique<Semaphore>(device_);
+
+        // The upload buffer is written once by the CPU and read by whatever the frame records,
+        // so it stays mapped for its whole lifetime.
+        frame.upload_buffer = allocator.AllocateBuffer({
+            .buffer_size = static_cast<uint32_t>(frame_desc_.upload_buffer_size),
+            .buffer_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            .resource_desc = {
+                .allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            }
+        });
+        frame.upload_data = static_cast<uint8_t*>(frame.upload_buffer->MapToCPU());
+        frame.upload_offset = 0;
+
+        frame.descriptor_pool = std::make_unique<DescriptorPool>(device_);
+    }
+}
\ No newline at end of file
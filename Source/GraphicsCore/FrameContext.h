@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Command.h"
+#include "DescriptorBuffer.h"
+#include "DescriptorSetCache.h"
+#include "Device.h"
+#include "Parameters.h"
+#include "Resources.h"
+#include "Synchronization.h"
+
+// A ring of per-frame slots, so the CPU can record frame N+1 while the GPU is still executing frame N.
+// Each slot owns everything that can only be reused once its frame is done on the GPU: command pools,
+// a fence, the semaphore for acquiring the swapchain image, a linear upload buffer and a descriptor pool.
+class FrameContext {
+public:
+    struct Desc {
+        uint32_t num_frames_in_flight = 2;
+        uint32_t num_threads = 1;
+        VkDeviceSize upload_buffer_size = 16 * 1024 * 1024;
+        // Only used when the device uses descriptor buffers.
+        VkDeviceSize descriptor_buffer_size = 1024 * 1024;
+    };
+
+    // A piece of the current frame's upload buffer. It stays valid until the slot comes around again.
+    struct UploadAllocation {
+        std::shared_ptr<Buffer> buffer;
+        VkDeviceSize offset;
+        void* data;
+    };
+
+    FrameContext(std::shared_ptr<Device> device, Allocator& allocator, const Desc& frame_desc);
+    ~FrameContext();
+
+    // Moves on to the next slot and waits until the frame that last used it is done on the GPU,
+    // after which its command buffers and upload memory are recycled.
+    void BeginFrame();
+
+    CommandBuffer AllocateCommandBuffer(Device::QueueType queue_type = Device::QueueType::GRAPHICS, uint32_t thread_index = 0);
+    UploadAllocation AllocateUpload(VkDeviceSize size, VkDeviceSize alignment = 16);
+    // Transient sets are only valid for the current frame, they are all released at once when the slot comes around again.
+    std::shared_ptr<DescriptorSet> AllocateTransientDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout);
+
+    // For sets that are written with the same resources every frame, instead of allocating transient ones.
+    inline DescriptorSetCache& GetDescriptorSetCache() {return *descriptor_set_cache_;}
+    // Takes the place of transient sets and the set cache when the device uses descriptor buffers, null otherwise.
+    inline DescriptorBuffer* GetDescriptorBuffer() {return descriptor_buffer_.get();}
+
+    // The last submit of the frame has to signal the fence, or the slot will never be reused.
+    inline Fence& GetFence() {return *frames_[frame_index_].fence;}
+    inline Semaphore& GetImageAvailableSemaphore() {return *frames_[frame_index_].image_available_semaphore;}
+
+    inline uint32_t GetFrameIndex() const {return frame_index_;}
+    inline uint64_t GetFrameNumber() const {return frame_number_;}
+    inline uint32_t GetNumFramesInFlight() const {return frame_desc_.num_frames_in_flight;}
+
+private:
+    struct Frame {
+        std::unique_ptr<Fence> fence;
+        std::unique_ptr<Semaphore> image_available_semaphore;
+
+        std::shared_ptr<Buffer> upload_buffer;
+        uint8_t* upload_data;
+        VkDeviceSize upload_offset;
+
+        std::unique_ptr<DescriptorPool> descriptor_pool;
+    };
+
+    std::shared_ptr<Device> device_;
+    Desc frame_desc_;
+
+    std::vector<Frame> frames_;
+    std::unique_ptr<CommandPoolRing> command_rings_[Device::QueueType::MAX_QUEUE_TYPES];
+    std::unique_ptr<DescriptorSetCache> descriptor_set_cache_;
+    std::unique_ptr<DescriptorBuffer> descriptor_buffer_;
+
+    uint32_t frame_index_;
+    uint64_t frame_number_;
+
+    void CreateFrames(Allocator& allocator);
+};
\ No newline at end of file
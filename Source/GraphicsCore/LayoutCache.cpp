@@ -0,0 +1,81 @@
+#include "LayoutCache.h"
+
+#include <algorithm>
+
+#include "../CoreUtility/Hash.h"
+#include "Device.h"
+
+// Entries whose layouts have been destroyed are dropped whenever their bucket is looked at again.
+template<typename Entry, typename Handle> static void RemoveExpiredEntries(std::vector<Entry>& entries, std::weak_ptr<Handle> Entry::* handle) {
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+        return (entry.*handle).expired();
+    }), entries.end());
+}
+
+LayoutCache::LayoutCache(Device& device) :
+    device_{ device }
+{}
+
+std::shared_ptr<DescriptorSetLayout> LayoutCache::GetDescriptorSetLayout(const std::vector<DescriptorSetLayout::BindingInfo>& bindings, VkDescriptorSetLayoutCreateFlags creation_flags) {
+    std::vector<DescriptorSetLayout::BindingInfo> sorted_bindings = bindings;
+    std::sort(sorted_bindings.begin(), sorted_bindings.end(), [](const auto& first, const auto& second) {
+        return first.binding < second.binding;
+    });
+
+    uint64_t hash = HashValue(creation_flags);
+    for (const DescriptorSetLayout::BindingInfo& binding : sorted_bindings) {
+        hash = HashValue(binding.binding, hash);
+        hash = HashValue(binding.descriptor_type, hash);
+        hash = HashValue(binding.descriptor_count, hash);
+        hash = HashValue(binding.stage_flags, hash);
+        hash = HashValue(binding.binding_flags, hash);
+    }
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    std::vector<SetLayoutEntry>& entries = set_layouts_[hash];
+    RemoveExpiredEntries(entries, &SetLayoutEntry::set_layout);
+
+    for (const SetLayoutEntry& entry : entries) {
+        if (entry.creation_flags == creation_flags && entry.bindings == sorted_bindings) {
+            // The last user can let go of the layout on another thread at any point.
+            if (std::shared_ptr<DescriptorSetLayout> set_layout = entry.set_layout.lock()) {
+                return set_layout;
+            }
+        }
+    }
+
+    std::shared_ptr<DescriptorSetLayout> set_layout = std::make_shared<DescriptorSetLayout>(device_.shared_from_this(), creation_flags);
+    for (const DescriptorSetLayout::BindingInfo& binding : sorted_bindings) {
+        set_layout->AddBinding(binding);
+    }
+    set_layout->Compile();
+
+    entries.push_back(SetLayoutEntry{sorted_bindings, creation_flags, set_layout});
+    return set_layout;
+}
+
+std::shared_ptr<PipelineLayout> LayoutCache::GetPipelineLayout(const std::vector<std::shared_ptr<DescriptorSetLayout>>& set_layouts) {
+    // Set layouts are deduplicated too, so their handles identify their contents.
+    std::vector<VkDescriptorSetLayout> set_layout_handles;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (const std::shared_ptr<DescriptorSetLayout>& set_layout : set_layouts) {
+        set_layout_handles.push_back(set_layout->GetLayout());
+        hash = HashValue(set_layout_handles.back(), hash);
+    }
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    std::vector<PipelineLayoutEntry>& entries = pipeline_layouts_[hash];
+    RemoveExpiredEntries(entries, &PipelineLayoutEntry::pipeline_layout);
+
+    for (const PipelineLayoutEntry& entry : entries) {
+        if (entry.set_layouts == set_layout_handles) {
+            if (std::shared_ptr<PipelineLayout> pipeline_layout = entry.pipeline_layout.lock()) {
+                return pipeline_layout;
+            }
+        }
+    }
+
+    std::shared_ptr<PipelineLayout> pipeline_layout = std::make_shared<PipelineLayout>(device_.shared_from_this(), set_layouts);
+    entries.push_back(PipelineLayoutEntry{set_layout_handles, pipeline_layout});
+    return pipeline_layout;
+}
\ No newline at end of file
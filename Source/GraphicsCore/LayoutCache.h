@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Parameters.h"
+
+class Device;
+
+// Hands out shared descriptor set layouts and pipeline layouts, so that identical layouts are the same
+// object (and the same Vulkan handle) everywhere. That keeps pipelines built from different shaders
+// compatible with each other, so descriptor sets stay bound when switching between them.
+// Only weak references are kept, so layouts are destroyed once nothing uses them anymore.
+class LayoutCache {
+public:
+    LayoutCache(Device& device);
+    ~LayoutCache() = default;
+
+    LayoutCache(const LayoutCache&) = delete;
+    LayoutCache& operator=(const LayoutCache&) = delete;
+
+    // The order of the bindings doesn't matter.
+    std::shared_ptr<DescriptorSetLayout> GetDescriptorSetLayout(const std::vector<DescriptorSetLayout::BindingInfo>& bindings, VkDescriptorSetLayoutCreateFlags creation_flags = 0);
+    std::shared_ptr<PipelineLayout> GetPipelineLayout(const std::vector<std::shared_ptr<DescriptorSetLayout>>& set_layouts);
+
+private:
+    struct SetLayoutEntry {
+        std::vector<DescriptorSetLayout::BindingInfo> bindings;
+        VkDescriptorSetLayoutCreateFlags creation_flags;
+        std::weak_ptr<DescriptorSetLayout> set_layout;
+    };
+
+    struct PipelineLayoutEntry {
+        std::vector<VkDescriptorSetLayout> set_layouts;
+        std::weak_ptr<PipelineLayout> pipeline_layout;
+    };
+
+    Device& device_;
+
+    // Layouts are created from shader compiler workers too.
+    std::mutex mutex_;
+    // Entries with the same hash are compared in full, so collisions only cost a comparison.
+    std::unordered_map<uint64_t, std::vector<SetLayoutEntry>> set_layouts_;
+    std::unordered_map<uint64_t, std::vector<PipelineLayoutEntry>> pipeline_layouts_;
+};
@@ -1,68 +1,62 @@
 #include "Parameters.h"
 
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
 DescriptorSet::DescriptorSet(std::shared_ptr<Device> device, std::shared_ptr<DescriptorSetLayout> set_layout) :
     device_{ device },
-    set_layout_{ set_layout }
+    set_layout_{ set_layout },
+    descriptors_(set_layout->GetNumDescriptors())
 {}
 
-void DescriptorSet::WriteBufferDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<Buffer> buffer, uint32_t offset, uint32_t range) {
+void DescriptorSet::WriteBufferDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<Buffer> buffer, uint32_t offset, uint32_t range, uint32_t array_element) {
     assert(type == set_layout_->GetType(binding));
 
-    VkDescriptorBufferInfo& buffer_info = buffer_infos_.emplace_back(
-        VkDescriptorBufferInfo {
-            .buffer = buffer->GetBuffer(),
-            .offset = offset,
-            .range = range,
-        }
-    );
-
-    VkWriteDescriptorSet buffer_descriptor = {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .dstSet = descriptor_set_,
-        .dstBinding = binding,
-        .descriptorCount = 1,
-        .descriptorType = type,
-        .pBufferInfo = &buffer_info,
+    descriptors_[set_layout_->GetDescriptorOffset(binding) + array_element].buffer = {
+        .buffer = buffer->GetBuffer(),
+        .offset = offset,
+        .range = range,
     };
-
-    write_infos_.push_back(buffer_descriptor);
 }
 
-void DescriptorSet::WriteImageDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler, VkImageLayout layout) {
+void DescriptorSet::WriteImageDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler, VkImageLayout layout, uint32_t array_element) {
     assert(type == set_layout_->GetType(binding));
 
-    VkDescriptorImageInfo& image_info = image_infos_.emplace_back(
-        VkDescriptorImageInfo {
-            .sampler = sampler->GetSampler(),
-            .imageView = image_view->GetImageView(),
-            .imageLayout = layout,
-        }
-    );
-
-    VkWriteDescriptorSet image_descriptor = {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .dstSet = descriptor_set_,
-        .dstBinding = binding,
-        .descriptorCount = 1,
-        .descriptorType = type,
-        .pImageInfo = &image_info,
+    // Sampled and storage images don't have a sampler.
+    descriptors_[set_layout_->GetDescriptorOffset(binding) + array_element].image = {
+        .sampler = (sampler != nullptr) ? sampler->GetSampler() : VK_NULL_HANDLE,
+        .imageView = image_view->GetImageView(),
+        .imageLayout = layout,
     };
-
-    write_infos_.push_back(image_descriptor);
 }
 
 void DescriptorSet::Update() {
-    vkUpdateDescriptorSets(device_->GetLogicalDevice(), static_cast<uint32_t>(write_infos_.size()), write_infos_.data(), 0, nullptr);
+    Update(descriptors_.data());
+}
+
+void DescriptorSet::Update(const DescriptorSetLayout::DescriptorInfo* descriptors) {
+    if (set_layout_->GetUpdateTemplate() != VK_NULL_HANDLE) {
+        vkUpdateDescriptorSetWithTemplate(device_->GetLogicalDevice(), descriptor_set_, set_layout_->GetUpdateTemplate(), descriptors);
+    }
 }
 
 DescriptorSetLayout::DescriptorSetLayout(std::shared_ptr<Device> device, VkDescriptorSetLayoutCreateFlags creation_flags) :
     device_{ device },
     creation_flags_{ creation_flags },
+    num_descriptors_{ 0 },
     is_compiled_{ false },
-    set_layout_{ VK_NULL_HANDLE }
+    set_layout_{ VK_NULL_HANDLE },
+    update_template_{ VK_NULL_HANDLE }
 {}
 
 DescriptorSetLayout::~DescriptorSetLayout() {
+    if (update_template_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorUpdateTemplate(device_->GetLogicalDevice(), update_template_, nullptr);
+    }
+
     if (set_layout_ != VK_NULL_HANDLE) {
         vkDestroyDescriptorSetLayout(device_->GetLogicalDevice(), set_layout_, nullptr);
     }
@@ -72,13 +66,50 @@ void DescriptorSetLayout::AddBinding(BindingInfo binding) {
     assert(!is_compiled_);
 
     VkDescriptorSetLayoutBinding binding_info = {
-        .binding = static_cast<uint32_t>(layout_bindings_.size()),
+        .binding = binding.binding,
         .descriptorType = binding.descriptor_type,
-        .descriptorCount = 1,
+        .descriptorCount = binding.descriptor_count,
         .stageFlags = binding.stage_flags,
     };
 
     layout_bindings_.push_back(binding_info);
+    binding_flags_.push_back(binding.binding_flags);
+    descriptor_offsets_.push_back(num_descriptors_);
+    num_descriptors_ += binding.descriptor_count;
+}
+
+std::vector<DescriptorSetLayout::BindingInfo> DescriptorSetLayout::GetBindingInfos() const {
+    std::vector<BindingInfo> bindings;
+    for (size_t binding_index = 0; binding_index < layout_bindings_.size(); binding_index++) {
+        const VkDescriptorSetLayoutBinding& layout_binding = layout_bindings_[binding_index];
+        bindings.push_back({
+            .binding = layout_binding.binding,
+            .descriptor_type = layout_binding.descriptorType,
+            .descriptor_count = layout_binding.descriptorCount,
+            .stage_flags = layout_binding.stageFlags,
+            .binding_flags = binding_flags_[binding_index],
+        });
+    }
+    return bindings;
+}
+
+VkDescriptorType DescriptorSetLayout::GetType(uint32_t binding) const {
+    return layout_bindings_[FindBinding(binding)].descriptorType;
+}
+
+uint32_t DescriptorSetLayout::GetDescriptorOffset(uint32_t binding) const {
+    return descriptor_offsets_[FindBinding(binding)];
+}
+
+size_t DescriptorSetLayout::FindBinding(uint32_t binding) const {
+    // Binding numbers don't have to be contiguous, so they can't be used as an index.
+    for (size_t binding_index = 0; binding_index < layout_bindings_.size(); binding_index++) {
+        if (layout_bindings_[binding_index].binding == binding) {
+            return binding_index;
+        }
+    }
+
+    throw std::runtime_error("Descriptor set layout has no binding " + std::to_string(binding) + "!");
 }
 
 void DescriptorSetLayout::Compile() {
@@ -89,68 +120,241 @@ void DescriptorSetLayout::Compile() {
         .pBindings = layout_bindings_.data()
     };
 
-    vkCreateDescriptorSetLayout(device_->GetLogicalDevice(), &layout_info, nullptr, &set_layout_);
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(binding_flags_.size()),
+        .pBindingFlags = binding_flags_.data(),
+    };
+
+    VkDescriptorBindingFlags all_binding_flags = 0;
+    for (VkDescriptorBindingFlags binding_flags : binding_flags_) {
+        all_binding_flags |= binding_flags;
+    }
+
+    if (all_binding_flags != 0) {
+        layout_info.pNext = &binding_flags_info;
+    }
+
+    // Descriptor buffers can be written at any time anyway, and they have no pools or update templates.
+    if (device_->UsesDescriptorBuffers()) {
+        layout_info.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+    } else if (all_binding_flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+        layout_info.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+
+    if (vkCreateDescriptorSetLayout(device_->GetLogicalDevice(), &layout_info, nullptr, &set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout!");
+    }
+
+    if (!device_->UsesDescriptorBuffers()) {
+        CreateUpdateTemplate();
+    }
     is_compiled_ = true;
 }
 
-DescriptorPool::DescriptorPool(std::shared_ptr<Device> device, VkDescriptorPoolCreateFlags creation_flags) :
+void DescriptorSetLayout::CreateUpdateTemplate() {
+    // A template needs at least one entry, and a set without bindings has nothing to update anyway.
+    if (layout_bindings_.empty()) {
+        return;
+    }
+
+    std::vector<VkDescriptorUpdateTemplateEntry> template_entries;
+    for (size_t binding_index = 0; binding_index < layout_bindings_.size(); binding_index++) {
+        const VkDescriptorSetLayoutBinding& layout_binding = layout_bindings_[binding_index];
+        template_entries.push_back({
+            .dstBinding = layout_binding.binding,
+            .dstArrayElement = 0,
+            .descriptorCount = layout_binding.descriptorCount,
+            .descriptorType = layout_binding.descriptorType,
+            .offset = descriptor_offsets_[binding_index] * sizeof(DescriptorInfo),
+            .stride = sizeof(DescriptorInfo),
+        });
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo template_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+        .descriptorUpdateEntryCount = static_cast<uint32_t>(template_entries.size()),
+        .pDescriptorUpdateEntries = template_entries.data(),
+        .templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+        .descriptorSetLayout = set_layout_,
+    };
+
+    if (vkCreateDescriptorUpdateTemplate(device_->GetLogicalDevice(), &template_info, nullptr, &update_template_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor update template!");
+    }
+}
+
+PipelineLayout::PipelineLayout(std::shared_ptr<Device> device, std::vector<std::shared_ptr<DescriptorSetLayout>> set_layouts) :
     device_{ device },
-    creation_flags_{ creation_flags }
+    set_layouts_{ std::move(set_layouts) },
+    pipeline_layout_{ VK_NULL_HANDLE }
 {
-    CreateDescriptorPool();
+    std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
+    for (const std::shared_ptr<DescriptorSetLayout>& set_layout : set_layouts_) {
+        assert(set_layout->IsCompiled());
+        descriptor_set_layouts.push_back(set_layout->GetLayout());
+    }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(descriptor_set_layouts.size()),
+        .pSetLayouts = descriptor_set_layouts.data(),
+    };
+
+    if (vkCreatePipelineLayout(device_->GetLogicalDevice(), &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+}
+
+PipelineLayout::~PipelineLayout() {
+    if (pipeline_layout_ != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device_->GetLogicalDevice(), pipeline_layout_, nullptr);
+    }
+}
+
+bool PipelineLayout::IsCompatibleForSet(const PipelineLayout& other, uint32_t set) const {
+    if (set >= set_layouts_.size() || set >= other.set_layouts_.size()) {
+        return false;
+    }
+
+    // Set layouts come from the device's layout cache, so identical layouts are the same object.
+    for (uint32_t set_index = 0; set_index <= set; set_index++) {
+        if (set_layouts_[set_index] != other.set_layouts_[set_index]) {
+            return false;
+        }
+    }
+    return true;
 }
 
+// Before anything was allocated, pools are sized for sets of a few buffers and textures.
+static constexpr uint32_t DEFAULT_DESCRIPTORS_PER_SET = 4;
+static constexpr VkDescriptorType DEFAULT_DESCRIPTOR_TYPES[] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+};
+
+DescriptorPool::DescriptorPool(std::shared_ptr<Device> device, VkDescriptorPoolCreateFlags creation_flags, uint32_t initial_sets_per_pool) :
+    device_{ device },
+    creation_flags_{ creation_flags },
+    sets_per_pool_{ initial_sets_per_pool },
+    current_pool_{ VK_NULL_HANDLE },
+    num_allocated_sets_{ 0 }
+{}
+
 DescriptorPool::~DescriptorPool() {
-    while (!descriptor_pools_.empty()) {
-        VkDescriptorPool descriptor_pool = descriptor_pools_.top();
-        descriptor_pools_.pop();
+    for (VkDescriptorPool descriptor_pool : used_pools_) {
+        vkDestroyDescriptorPool(device_->GetLogicalDevice(), descriptor_pool, nullptr);
+    }
+
+    for (VkDescriptorPool descriptor_pool : free_pools_) {
         vkDestroyDescriptorPool(device_->GetLogicalDevice(), descriptor_pool, nullptr);
     }
 }
 
 std::shared_ptr<DescriptorSet> DescriptorPool::AllocateDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout) {
-    assert(!descriptor_pools_.empty() && layout->IsCompiled());
+    assert(layout->IsCompiled() && !device_->UsesDescriptorBuffers());
 
-    VkDescriptorSetLayout set_layout = layout->GetLayout();
-    VkDescriptorSetAllocateInfo descriptor_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pools_.top(),
-        .descriptorSetCount = 1,
-        .pSetLayouts = &set_layout,
-    };
+    std::unordered_map<VkDescriptorType, uint32_t> required_descriptors;
+    for (const VkDescriptorSetLayoutBinding& binding : layout->GetBindings()) {
+        required_descriptors[binding.descriptorType] += binding.descriptorCount;
+    }
+
+    // The set is counted before allocating, so that a pool created for it is sized for it as well.
+    num_allocated_sets_++;
+    for (const auto& [descriptor_type, descriptor_count] : required_descriptors) {
+        num_allocated_descriptors_[descriptor_type] += descriptor_count;
+    }
 
     std::shared_ptr<DescriptorSet> descriptor_set = std::make_shared<DescriptorSet>(device_, layout);
-    vkAllocateDescriptorSets(device_->GetLogicalDevice(), &descriptor_info, &descriptor_set->descriptor_set_);
-    return descriptor_set;
-}
-
-void DescriptorPool::CreateDescriptorPool() {
-    const uint32_t num_descriptors = 100;
-
-    std::vector<VkDescriptorPoolSize> pool_sizes = {
-        {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = num_descriptors,
-        },
-        {
-            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = num_descriptors,
-        },
-        {
-            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = num_descriptors,
-        },
-    };
+    VkDescriptorSetLayout set_layout = layout->GetLayout();
+
+    bool is_new_pool = false;
+    if (current_pool_ == VK_NULL_HANDLE) {
+        is_new_pool = NextDescriptorPool(required_descriptors);
+    }
+
+    while (true) {
+        VkDescriptorSetAllocateInfo descriptor_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = current_pool_,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &set_layout,
+        };
+
+        VkResult result = vkAllocateDescriptorSets(device_->GetLogicalDevice(), &descriptor_info, &descriptor_set->descriptor_set_);
+        if (result == VK_SUCCESS) {
+            return descriptor_set;
+        }
+
+        // A pool that was just created for the set can only fail for reasons another pool won't fix.
+        if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || is_new_pool) {
+            throw std::runtime_error("Failed to allocate descriptor set!");
+        }
+
+        is_new_pool = NextDescriptorPool(required_descriptors);
+    }
+}
+
+void DescriptorPool::Reset() {
+    for (VkDescriptorPool descriptor_pool : used_pools_) {
+        vkResetDescriptorPool(device_->GetLogicalDevice(), descriptor_pool, 0);
+        free_pools_.push_back(descriptor_pool);
+    }
+
+    used_pools_.clear();
+    current_pool_ = VK_NULL_HANDLE;
+}
+
+bool DescriptorPool::NextDescriptorPool(const std::unordered_map<VkDescriptorType, uint32_t>& required_descriptors) {
+    if (!free_pools_.empty()) {
+        current_pool_ = free_pools_.back();
+        free_pools_.pop_back();
+        used_pools_.push_back(current_pool_);
+        return false;
+    }
+
+    std::unordered_map<VkDescriptorType, uint32_t> descriptor_counts;
+    if (num_allocated_descriptors_.empty()) {
+        for (VkDescriptorType descriptor_type : DEFAULT_DESCRIPTOR_TYPES) {
+            descriptor_counts[descriptor_type] = DEFAULT_DESCRIPTORS_PER_SET * sets_per_pool_;
+        }
+    } else {
+        for (const auto& [descriptor_type, num_descriptors] : num_allocated_descriptors_) {
+            uint64_t descriptor_count = (num_descriptors * sets_per_pool_ + num_allocated_sets_ - 1) / num_allocated_sets_;
+            descriptor_counts[descriptor_type] = static_cast<uint32_t>(descriptor_count);
+        }
+    }
+
+    // However skewed the average is, the set that asked for the pool has to fit into it.
+    for (const auto& [descriptor_type, descriptor_count] : required_descriptors) {
+        descriptor_counts[descriptor_type] = std::max(descriptor_counts[descriptor_type], descriptor_count);
+    }
+
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (const auto& [descriptor_type, descriptor_count] : descriptor_counts) {
+        if (descriptor_count > 0) {
+            pool_sizes.push_back({
+                .type = descriptor_type,
+                .descriptorCount = descriptor_count,
+            });
+        }
+    }
 
     VkDescriptorPoolCreateInfo pool_info = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .flags = creation_flags_,
-        .maxSets = 10,
+        .maxSets = sets_per_pool_,
         .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
         .pPoolSizes = pool_sizes.data(),
     };
 
-    VkDescriptorPool descriptor_pool;
-    vkCreateDescriptorPool(device_->GetLogicalDevice(), &pool_info, nullptr, &descriptor_pool);
-    descriptor_pools_.push(descriptor_pool);
+    if (vkCreateDescriptorPool(device_->GetLogicalDevice(), &pool_info, nullptr, &current_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool!");
+    }
+    used_pools_.push_back(current_pool_);
+
+    // Every pool that runs out means more sets are needed than expected, so the next one is bigger.
+    sets_per_pool_ = std::min(sets_per_pool_ * 2, MAX_SETS_PER_POOL);
+    return true;
 }
\ No newline at end of file
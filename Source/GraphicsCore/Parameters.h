@@ -1,8 +1,7 @@
 #pragma once
 
-#include <deque>
 #include <memory>
-#include <stack>
+#include <unordered_map>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -14,8 +13,23 @@
 class DescriptorSetLayout {
 public:
     struct BindingInfo {
+        uint32_t binding;
         VkDescriptorType descriptor_type;
+        // More than one for arrays of descriptors.
+        uint32_t descriptor_count = 1;
         VkShaderStageFlags stage_flags;
+        // Bindings that are updated after being bound make the whole layout an update-after-bind one.
+        VkDescriptorBindingFlags binding_flags = 0;
+
+        bool operator==(const BindingInfo& other) const = default;
+    };
+
+    // A single descriptor the way vkUpdateDescriptorSetWithTemplate reads it. The contents of a set are
+    // an array of these, with the descriptors of each binding starting at GetDescriptorOffset().
+    union DescriptorInfo {
+        VkDescriptorBufferInfo buffer;
+        VkDescriptorImageInfo image;
+        VkBufferView texel_buffer_view;
     };
 
     DescriptorSetLayout(std::shared_ptr<Device> device, VkDescriptorSetLayoutCreateFlags creation_flags = 0);
@@ -26,15 +40,50 @@ public:
 
     inline VkDescriptorSetLayout GetLayout() const {return set_layout_;}
     inline bool IsCompiled() const {return is_compiled_;}
-    inline VkDescriptorType GetType(uint32_t binding) const {return layout_bindings_.at(binding).descriptorType;}
+    inline const std::vector<VkDescriptorSetLayoutBinding>& GetBindings() const {return layout_bindings_;}
+    // The bindings the way they were added, including their binding flags.
+    std::vector<BindingInfo> GetBindingInfos() const;
+    VkDescriptorType GetType(uint32_t binding) const;
+
+    // The update template writes all descriptors of a set at once, and is created along with the layout.
+    inline VkDescriptorUpdateTemplate GetUpdateTemplate() const {return update_template_;}
+    inline uint32_t GetNumDescriptors() const {return num_descriptors_;}
+    uint32_t GetDescriptorOffset(uint32_t binding) const;
 
 private:
     std::shared_ptr<Device> device_;
     std::vector<VkDescriptorSetLayoutBinding> layout_bindings_;
+    std::vector<VkDescriptorBindingFlags> binding_flags_;
+    // Where the descriptors of each binding start, in the same order as the bindings.
+    std::vector<uint32_t> descriptor_offsets_;
+    uint32_t num_descriptors_;
 
     bool is_compiled_;
     VkDescriptorSetLayoutCreateFlags creation_flags_;
     VkDescriptorSetLayout set_layout_;
+    VkDescriptorUpdateTemplate update_template_;
+
+    size_t FindBinding(uint32_t binding) const;
+    void CreateUpdateTemplate();
+};
+
+class PipelineLayout {
+public:
+    PipelineLayout(std::shared_ptr<Device> device, std::vector<std::shared_ptr<DescriptorSetLayout>> set_layouts);
+    ~PipelineLayout();
+
+    inline VkPipelineLayout GetLayout() const {return pipeline_layout_;}
+    inline const std::vector<std::shared_ptr<DescriptorSetLayout>>& GetSetLayouts() const {return set_layouts_;}
+
+    // Descriptor sets bound for one layout stay bound when switching to another layout, as long as
+    // both have the same set layouts up to and including that set.
+    bool IsCompatibleForSet(const PipelineLayout& other, uint32_t set) const;
+
+private:
+    std::shared_ptr<Device> device_;
+    std::vector<std::shared_ptr<DescriptorSetLayout>> set_layouts_;
+
+    VkPipelineLayout pipeline_layout_;
 };
 
 class DescriptorSet {
@@ -43,10 +92,13 @@ public:
 
     DescriptorSet(std::shared_ptr<Device> device, std::shared_ptr<DescriptorSetLayout> set_layout);
 
-    void WriteBufferDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<Buffer> buffer, uint32_t offset, uint32_t range);
-    void WriteImageDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler, VkImageLayout layout);
+    // Writes only change what the next Update() writes, every descriptor of the set has to be written before that.
+    void WriteBufferDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<Buffer> buffer, uint32_t offset, uint32_t range, uint32_t array_element = 0);
+    void WriteImageDescriptor(uint32_t binding, VkDescriptorType type, std::shared_ptr<ImageView> image_view, std::shared_ptr<Sampler> sampler, VkImageLayout layout, uint32_t array_element = 0);
 
     void Update();
+    // Writes the whole set from descriptors packed the way the layout describes, without going through the Write functions.
+    void Update(const DescriptorSetLayout::DescriptorInfo* descriptors);
 
     inline VkDescriptorSet GetDescriptorSet() const {return descriptor_set_;}
 
@@ -55,22 +107,39 @@ private:
     std::shared_ptr<DescriptorSetLayout> set_layout_;
 
     VkDescriptorSet descriptor_set_;
-    std::deque<VkDescriptorBufferInfo> buffer_infos_;
-    std::deque<VkDescriptorImageInfo> image_infos_;
-    std::vector<VkWriteDescriptorSet> write_infos_;
+    std::vector<DescriptorSetLayout::DescriptorInfo> descriptors_;
 };
 
+// Descriptor sets come from a chain of pools. When one runs out, the next one is created with room for more
+// sets, and with as many descriptors of each type as the sets allocated so far needed on average.
+// Without VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, allocating is little more than a bump in the driver,
+// and sets are released all at once by Reset(), e.g. for sets that are only used for one frame.
 class DescriptorPool {
 public:
-    DescriptorPool(std::shared_ptr<Device> device, VkDescriptorPoolCreateFlags creation_flags = 0);
+    DescriptorPool(std::shared_ptr<Device> device, VkDescriptorPoolCreateFlags creation_flags = 0, uint32_t initial_sets_per_pool = 64);
     ~DescriptorPool();
 
     std::shared_ptr<DescriptorSet> AllocateDescriptorSet(std::shared_ptr<DescriptorSetLayout> layout);
 
+    // Releases every set allocated so far, which must not be in use by the GPU anymore and must not be used afterwards.
+    // The pools are kept around for the next allocations.
+    void Reset();
+
 private:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
     std::shared_ptr<Device> device_;
     VkDescriptorPoolCreateFlags creation_flags_;
-    std::stack<VkDescriptorPool> descriptor_pools_;
-    
-    void CreateDescriptorPool();
-};
+    uint32_t sets_per_pool_;
+
+    VkDescriptorPool current_pool_;
+    std::vector<VkDescriptorPool> used_pools_;
+    std::vector<VkDescriptorPool> free_pools_;
+
+    // What every set allocated from the pool so far needed, to size new pools from.
+    uint64_t num_allocated_sets_;
+    std::unordered_map<VkDescriptorType, uint64_t> num_allocated_descriptors_;
+
+    // Returns whether the pool is a new one, as opposed to one that was reset.
+    bool NextDescriptorPool(const std::unordered_map<VkDescriptorType, uint32_t>& required_descriptors);
+};
\ No newline at end of file
@@ -1,91 +1,265 @@
 #include "Pipeline.h"
 
-#include <array>
-#include <GLM/glm.hpp>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+
+#include "PipelineCache.h"
 
 GraphicsPipeline::GraphicsPipeline(std::shared_ptr<Device> device, ShaderStages shaders, const AttachmentFormats& attachment_formats) :
+    GraphicsPipeline{ device, shaders, attachment_formats, State{} }
+{}
+
+GraphicsPipeline::GraphicsPipeline(std::shared_ptr<Device> device, ShaderStages shaders, const AttachmentFormats& attachment_formats, const State& state) :
     Pipeline{ device },
     shaders_{ shaders },
-    attachment_formats_{ attachment_formats }
+    attachment_formats_{ attachment_formats },
+    state_{ state },
+    is_optimized_{ false }
+{
+    Create();
+}
+
+GraphicsPipeline::GraphicsPipeline(std::shared_ptr<Device> device, const std::vector<std::shared_ptr<GraphicsPipelineLibrary>>& libraries, bool is_optimized) :
+    Pipeline{ device },
+    libraries_{ libraries },
+    is_optimized_{ is_optimized }
 {
+    if (libraries_.size() != GraphicsPipelineLibrary::MAX_PARTS) {
+        throw std::runtime_error("Failed to link graphics pipeline, it needs one library of every part!");
+    }
     Create();
 }
 
+// Merges two layouts of the same set binding by binding, so that every binding is visible to all stages that use it.
+// Binding flags are kept as they are, so e.g. merging the bindless heap's set with an empty one gives the heap's layout.
+static std::shared_ptr<DescriptorSetLayout> MergeParameterLayouts(std::shared_ptr<Device> device, const DescriptorSetLayout& first, const DescriptorSetLayout& second) {
+    std::vector<DescriptorSetLayout::BindingInfo> bindings = first.GetBindingInfos();
+    for (const DescriptorSetLayout::BindingInfo& binding : second.GetBindingInfos()) {
+        auto it = std::find_if(bindings.begin(), bindings.end(), [&](const DescriptorSetLayout::BindingInfo& other) {
+            return other.binding == binding.binding;
+        });
+
+        if (it == bindings.end()) {
+            bindings.push_back(binding);
+        } else if (it->descriptor_type != binding.descriptor_type || it->descriptor_count != binding.descriptor_count || it->binding_flags != binding.binding_flags) {
+            throw std::runtime_error("Failed to merge descriptor set layouts, binding " + std::to_string(binding.binding) + " differs between stages!");
+        } else {
+            it->stage_flags |= binding.stage_flags;
+        }
+    }
+
+    return device->GetLayoutCache().GetDescriptorSetLayout(bindings);
+}
+
 void GraphicsPipeline::CreatePipelineLayout() {
-    std::vector<VkDescriptorSetLayout> descriptor_sets;
-    const auto& vertex_descriptor_sets = shaders_.vertex_shader->GetParameterLayouts();
-    for (const auto& descriptor_set : vertex_descriptor_sets) {
-        descriptor_sets.push_back(descriptor_set->GetLayout());
+    if (!libraries_.empty()) {
+        pipeline_layout_ = libraries_[GraphicsPipelineLibrary::PRE_RASTERIZATION]->GetLayout();
+    } else {
+        pipeline_layout_ = GetMergedLayout(device_, shaders_);
     }
+}
 
-    const auto& fragment_descriptor_sets = shaders_.fragment_shader->GetParameterLayouts();
-    for (const auto& descriptor_set : fragment_descriptor_sets) {
-        descriptor_sets.push_back(descriptor_set->GetLayout());
+std::shared_ptr<PipelineLayout> GraphicsPipeline::GetMergedLayout(std::shared_ptr<Device> device, const ShaderStages& shaders) {
+    const auto& vertex_layouts = shaders.vertex_shader->GetParameterLayouts();
+    const auto& fragment_layouts = shaders.fragment_shader->GetParameterLayouts();
+
+    // Layouts are merged by set index. Sets only one of the shaders uses, or that both share because
+    // they have identical bindings, are used as they are.
+    std::vector<std::shared_ptr<DescriptorSetLayout>> parameter_layouts(std::max(vertex_layouts.size(), fragment_layouts.size()));
+    for (size_t set = 0; set < parameter_layouts.size(); set++) {
+        std::shared_ptr<DescriptorSetLayout> vertex_layout = (set < vertex_layouts.size()) ? vertex_layouts[set] : nullptr;
+        std::shared_ptr<DescriptorSetLayout> fragment_layout = (set < fragment_layouts.size()) ? fragment_layouts[set] : nullptr;
+
+        if (vertex_layout == nullptr || vertex_layout == fragment_layout) {
+            parameter_layouts[set] = fragment_layout;
+        } else if (fragment_layout == nullptr) {
+            parameter_layouts[set] = vertex_layout;
+        } else {
+            parameter_layouts[set] = MergeParameterLayouts(device, *vertex_layout, *fragment_layout);
+        }
     }
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = static_cast<uint32_t>(descriptor_sets.size()),
-        .pSetLayouts = descriptor_sets.data(),
-    };
+    return device->GetLayoutCache().GetPipelineLayout(parameter_layouts);
+}
 
-    vkCreatePipelineLayout(device_->GetLogicalDevice(), &pipeline_layout_info, nullptr, &pipeline_layout_);
+// Only the formats that make sense in a vertex buffer.
+static uint32_t GetVertexFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SNORM:
+        case VK_FORMAT_R8_UINT:
+        case VK_FORMAT_R8_SINT: {
+            return 1;
+        }
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SNORM:
+        case VK_FORMAT_R8G8_UINT:
+        case VK_FORMAT_R8G8_SINT:
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_SNORM:
+        case VK_FORMAT_R16_UINT:
+        case VK_FORMAT_R16_SINT:
+        case VK_FORMAT_R16_SFLOAT: {
+            return 2;
+        }
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+        case VK_FORMAT_R8G8B8A8_UINT:
+        case VK_FORMAT_R8G8B8A8_SINT:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+        case VK_FORMAT_A2B10G10R10_UINT_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_UINT:
+        case VK_FORMAT_R16G16_SINT:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_UINT:
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32_SFLOAT: {
+            return 4;
+        }
+        case VK_FORMAT_R16G16B16_SFLOAT: {
+            return 6;
+        }
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R16G16B16A16_UINT:
+        case VK_FORMAT_R16G16B16A16_SINT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_UINT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32_SFLOAT: {
+            return 8;
+        }
+        case VK_FORMAT_R32G32B32_UINT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32_SFLOAT: {
+            return 12;
+        }
+        case VK_FORMAT_R32G32B32A32_UINT:
+        case VK_FORMAT_R32G32B32A32_SINT:
+        case VK_FORMAT_R32G32B32A32_SFLOAT: {
+            return 16;
+        }
+        default: {
+            throw std::runtime_error("Unsupported vertex format!");
+        }
+    }
 }
 
-// TODO: this should not be here...
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 color;
-    glm::vec2 tex_coord;
-};
+// Semantics are case insensitive, like in HLSL.
+static bool IsSameSemantic(const std::string& first, const std::string& second) {
+    return std::equal(first.begin(), first.end(), second.begin(), second.end(), [](char first_char, char second_char) {
+        return std::toupper(static_cast<unsigned char>(first_char)) == std::toupper(static_cast<unsigned char>(second_char));
+    });
+}
 
-void GraphicsPipeline::CreatePipeline() {
-    // TODO: this should be handled through reflection...?
-    VkVertexInputBindingDescription binding_desc = {
-        .binding = 0,
-        .stride = sizeof(Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-    };
+void GraphicsPipeline::GetVertexInputDescriptions(const std::vector<Shader::VertexInput>& vertex_inputs, const std::vector<VertexStream>& vertex_streams,
+                                                  std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+    if (vertex_streams.empty()) {
+        uint32_t offset = 0;
+        for (const Shader::VertexInput& vertex_input : vertex_inputs) {
+            attributes.push_back({vertex_input.location, 0, vertex_input.format, offset});
+            offset += GetVertexFormatSize(vertex_input.format);
+        }
+
+        if (!attributes.empty()) {
+            bindings.push_back({0, offset, VK_VERTEX_INPUT_RATE_VERTEX});
+        }
+        return;
+    }
 
-    std::array<VkVertexInputAttributeDescription, 3> attributes;
+    for (uint32_t binding = 0; binding < vertex_streams.size(); binding++) {
+        uint32_t offset = 0;
+        for (const GraphicsPipeline::VertexAttribute& stream_attribute : vertex_streams[binding].attributes) {
+            auto vertex_input = std::find_if(vertex_inputs.begin(), vertex_inputs.end(), [&](const Shader::VertexInput& input) {
+                return IsSameSemantic(input.semantic, stream_attribute.semantic);
+            });
+
+            VkFormat format = stream_attribute.format;
+            if (format == VK_FORMAT_UNDEFINED) {
+                if (vertex_input == vertex_inputs.end()) {
+                    throw std::runtime_error("Failed to create pipeline, vertex attribute " + stream_attribute.semantic + " isn't read by the shader and needs a format!");
+                }
+                format = vertex_input->format;
+            }
+
+            if (vertex_input != vertex_inputs.end()) {
+                bool is_duplicate = std::any_of(attributes.begin(), attributes.end(), [&](const VkVertexInputAttributeDescription& attribute) {
+                    return attribute.location == vertex_input->location;
+                });
+                if (is_duplicate) {
+                    throw std::runtime_error("Failed to create pipeline, vertex attribute " + stream_attribute.semantic + " is in more than one place!");
+                }
+                attributes.push_back({vertex_input->location, binding, format, offset});
+            }
+            offset += GetVertexFormatSize(format);
+        }
+
+        bindings.push_back({binding, offset, vertex_streams[binding].input_rate});
+    }
 
-    attributes[0] = {
-        .location = 0,
-        .binding = 0,
-        .format = VK_FORMAT_R32G32B32_SFLOAT,
-        .offset = offsetof(Vertex, position),
-    };
+    for (const Shader::VertexInput& vertex_input : vertex_inputs) {
+        bool is_fed = std::any_of(attributes.begin(), attributes.end(), [&](const VkVertexInputAttributeDescription& attribute) {
+            return attribute.location == vertex_input.location;
+        });
+        if (!is_fed) {
+            throw std::runtime_error("Failed to create pipeline, vertex input " + vertex_input.semantic + " isn't in any vertex stream!");
+        }
+    }
+}
 
-    attributes[1] = {
-        .location = 1,
-        .binding = 0,
-        .format = VK_FORMAT_R32G32B32_SFLOAT,
-        .offset = offsetof(Vertex, color),
-    };
+// Everything vkCreateGraphicsPipelines reads for a pipeline, so whole pipelines and pipeline libraries are described
+// the same way. It points into itself, so it can't be copied.
+struct GraphicsPipelineCreateInfo {
+    std::vector<VkVertexInputBindingDescription> vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkPipelineVertexInputStateCreateInfo vertex_info;
+    VkPipelineInputAssemblyStateCreateInfo assembly_info;
+    VkPipelineViewportStateCreateInfo viewport_info;
+    VkPipelineRasterizationStateCreateInfo rasterization_info;
+    VkPipelineMultisampleStateCreateInfo multisample_info;
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info;
+    std::vector<VkPipelineColorBlendAttachmentState> attachment_blendings;
+    VkPipelineColorBlendStateCreateInfo color_blend_info;
+    std::vector<VkDynamicState> dynamic_states;
+    VkPipelineDynamicStateCreateInfo dynamic_state_info;
+    VkPipelineRenderingCreateInfoKHR pipeline_rendering_info;
+    // The vertex stage comes first.
+    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+    VkGraphicsPipelineCreateInfo pipeline_info;
 
-    attributes[2] = {
-        .location = 2,
-        .binding = 0,
-        .format = VK_FORMAT_R32G32_SFLOAT,
-        .offset = offsetof(Vertex, tex_coord),
-    };
+    GraphicsPipelineCreateInfo(const GraphicsPipeline::ShaderStages& shaders, const GraphicsPipeline::AttachmentFormats& attachment_formats,
+                               const GraphicsPipeline::State& state, VkPipelineLayout layout, VkPipelineCreateFlags flags);
+
+    GraphicsPipelineCreateInfo(const GraphicsPipelineCreateInfo&) = delete;
+    GraphicsPipelineCreateInfo& operator=(const GraphicsPipelineCreateInfo&) = delete;
+};
 
-    VkPipelineVertexInputStateCreateInfo vertex_info = {
+GraphicsPipelineCreateInfo::GraphicsPipelineCreateInfo(const GraphicsPipeline::ShaderStages& shaders, const GraphicsPipeline::AttachmentFormats& attachment_formats,
+                                                       const GraphicsPipeline::State& state, VkPipelineLayout layout, VkPipelineCreateFlags flags) {
+    GraphicsPipeline::GetVertexInputDescriptions(shaders.vertex_shader->GetVertexInputs(), state.vertex_streams, vertex_bindings, vertex_attributes);
+
+    vertex_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &binding_desc,
-        .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
-        .pVertexAttributeDescriptions = attributes.data(),
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_bindings.size()),
+        .pVertexBindingDescriptions = vertex_bindings.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attributes.size()),
+        .pVertexAttributeDescriptions = vertex_attributes.data(),
     };
 
-    VkPipelineInputAssemblyStateCreateInfo assembly_info = {
+    assembly_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .topology = state.topology,
         .primitiveRestartEnable = VK_FALSE,
     };
 
-    // TODO: some of this should be configurable
-    VkPipelineViewportStateCreateInfo viewport_info = {
+    viewport_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
         .pViewports = nullptr,
@@ -93,28 +267,28 @@ void GraphicsPipeline::CreatePipeline() {
         .pScissors = nullptr,
     };
 
-    VkPipelineRasterizationStateCreateInfo rasterization_info = {
+    rasterization_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
         .depthClampEnable = VK_FALSE,
         .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_NONE,
-        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .polygonMode = state.polygon_mode,
+        .cullMode = state.cull_mode,
+        .frontFace = state.front_face,
         .depthBiasEnable = VK_FALSE,
         .lineWidth = 1.0f,
     };
 
-    VkPipelineMultisampleStateCreateInfo multisample_info = {
+    multisample_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .rasterizationSamples = state.sample_count,
         .sampleShadingEnable = VK_FALSE,
     };
 
-    VkPipelineDepthStencilStateCreateInfo depth_stencil_info = {
+    depth_stencil_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_FALSE,
-        .depthWriteEnable = VK_TRUE,
-        .depthCompareOp = VK_COMPARE_OP_LESS,
+        .depthTestEnable = state.depth_test_enable,
+        .depthWriteEnable = state.depth_write_enable,
+        .depthCompareOp = state.depth_compare_op,
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
         .minDepthBounds = 0.0f,
@@ -122,42 +296,47 @@ void GraphicsPipeline::CreatePipeline() {
     };
 
     VkPipelineColorBlendAttachmentState attachment_blending = {
-        .blendEnable = VK_FALSE,
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = state.blend_enable,
+        .srcColorBlendFactor = state.src_color_blend_factor,
+        .dstColorBlendFactor = state.dst_color_blend_factor,
+        .colorBlendOp = state.color_blend_op,
+        .srcAlphaBlendFactor = state.src_alpha_blend_factor,
+        .dstAlphaBlendFactor = state.dst_alpha_blend_factor,
+        .alphaBlendOp = state.alpha_blend_op,
+        .colorWriteMask = state.color_write_mask,
     };
+    attachment_blendings.resize(attachment_formats.color_formats.size(), attachment_blending);
 
-    VkPipelineColorBlendStateCreateInfo color_blend_info = {
+    color_blend_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
         .logicOpEnable = VK_FALSE,
-        .attachmentCount = 1,
-        .pAttachments = &attachment_blending,
+        .attachmentCount = static_cast<uint32_t>(attachment_blendings.size()),
+        .pAttachments = attachment_blendings.data(),
     };
 
-    std::vector<VkDynamicState> dynamic_states = {
+    dynamic_states = {
         VK_DYNAMIC_STATE_VIEWPORT,
         VK_DYNAMIC_STATE_SCISSOR,
     };
 
-    VkPipelineDynamicStateCreateInfo dynamic_state_info = {
+    dynamic_state_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
         .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
         .pDynamicStates = dynamic_states.data(),
     };
 
-    VkPipelineRenderingCreateInfoKHR pipeline_rendering_info{
+    pipeline_rendering_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
-        .colorAttachmentCount = static_cast<uint32_t>(attachment_formats_.color_formats.size()),
-        .pColorAttachmentFormats = attachment_formats_.color_formats.data(),
-        .depthAttachmentFormat = attachment_formats_.depth_format,
-        .stencilAttachmentFormat = attachment_formats_.stencil_format,
+        .colorAttachmentCount = static_cast<uint32_t>(attachment_formats.color_formats.size()),
+        .pColorAttachmentFormats = attachment_formats.color_formats.data(),
+        .depthAttachmentFormat = attachment_formats.depth_format,
+        .stencilAttachmentFormat = attachment_formats.stencil_format,
     };
 
-    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
-
     VkPipelineShaderStageCreateInfo vertex_stage = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
         .stage = VK_SHADER_STAGE_VERTEX_BIT,
-        .module = shaders_.vertex_shader->GetModule(),
+        .module = shaders.vertex_shader->GetModule(),
         .pName = "main",
     };
     shader_stages.push_back(vertex_stage);
@@ -165,15 +344,15 @@ void GraphicsPipeline::CreatePipeline() {
     VkPipelineShaderStageCreateInfo fragment_stage = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-        .module = shaders_.fragment_shader->GetModule(),
+        .module = shaders.fragment_shader->GetModule(),
         .pName = "main",
     };
     shader_stages.push_back(fragment_stage);
 
-
-    VkGraphicsPipelineCreateInfo pipeline_info = {
+    pipeline_info = {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
         .pNext = &pipeline_rendering_info,
+        .flags = flags,
         .stageCount = static_cast<uint32_t>(shader_stages.size()),
         .pStages = shader_stages.data(),
         .pVertexInputState = &vertex_info,
@@ -184,35 +363,118 @@ void GraphicsPipeline::CreatePipeline() {
         .pDepthStencilState = &depth_stencil_info,
         .pColorBlendState = &color_blend_info,
         .pDynamicState = &dynamic_state_info,
-        .layout = pipeline_layout_,
+        .layout = layout,
         .renderPass = VK_NULL_HANDLE,
         .subpass = 0,
     };
+}
+
+void GraphicsPipeline::CreatePipeline() {
+    if (!libraries_.empty()) {
+        std::vector<VkPipeline> library_pipelines;
+        for (const std::shared_ptr<GraphicsPipelineLibrary>& library : libraries_) {
+            library_pipelines.push_back(library->GetPipeline());
+        }
+
+        VkPipelineLibraryCreateInfoKHR library_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+            .libraryCount = static_cast<uint32_t>(library_pipelines.size()),
+            .pLibraries = library_pipelines.data(),
+        };
+
+        // All the state is in the libraries, only the layout has to match them.
+        VkGraphicsPipelineCreateInfo pipeline_info = {
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = &library_info,
+            .flags = GetCreationFlags() | (is_optimized_ ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0),
+            .layout = pipeline_layout_->GetLayout(),
+        };
+
+        if (vkCreateGraphicsPipelines(device_->GetLogicalDevice(), device_->GetPipelineCache().GetPipelineCache(), 1, &pipeline_info, nullptr, &pipeline_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to link graphics pipeline!");
+        }
+        return;
+    }
 
-    vkCreateGraphicsPipelines(device_->GetLogicalDevice(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    GraphicsPipelineCreateInfo create_info{ shaders_, attachment_formats_, state_, pipeline_layout_->GetLayout(), GetCreationFlags() };
+    if (vkCreateGraphicsPipelines(device_->GetLogicalDevice(), device_->GetPipelineCache().GetPipelineCache(), 1, &create_info.pipeline_info, nullptr, &pipeline_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline!");
+    }
 }
 
-ComputePipeline::ComputePipeline(std::shared_ptr<Device> device, std::shared_ptr<Shader> compute_shader) :
+GraphicsPipelineLibrary::GraphicsPipelineLibrary(std::shared_ptr<Device> device, Part part, GraphicsPipeline::ShaderStages shaders,
+                                                 const GraphicsPipeline::AttachmentFormats& attachment_formats, const GraphicsPipeline::State& state) :
     Pipeline{ device },
-    compute_shader_{ compute_shader }
+    part_{ part },
+    shaders_{ shaders },
+    attachment_formats_{ attachment_formats },
+    state_{ state }
 {
     Create();
 }
 
-void ComputePipeline::CreatePipelineLayout() {
-    std::vector<VkDescriptorSetLayout> descriptor_sets;
-    const auto& compute_descriptor_sets = compute_shader_->GetParameterLayouts();
-    for (const auto& descriptor_set : compute_descriptor_sets) {
-        descriptor_sets.push_back(descriptor_set->GetLayout());
-    }
+void GraphicsPipelineLibrary::CreatePipelineLayout() {
+    // The shader parts have to be created with the layout of the linked pipeline. The other parts don't use it.
+    pipeline_layout_ = GraphicsPipeline::GetMergedLayout(device_, shaders_);
+}
+
+void GraphicsPipelineLibrary::CreatePipeline() {
+    GraphicsPipelineCreateInfo create_info{ shaders_, attachment_formats_, state_, pipeline_layout_->GetLayout(), GetCreationFlags() };
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = static_cast<uint32_t>(descriptor_sets.size()),
-        .pSetLayouts = descriptor_sets.data(),
+    VkGraphicsPipelineLibraryCreateInfoEXT library_info = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = create_info.pipeline_info.pNext,
     };
 
-    vkCreatePipelineLayout(device_->GetLogicalDevice(), &pipeline_layout_info, nullptr, &pipeline_layout_);
+    // Only the part's own shader stage is compiled.
+    VkGraphicsPipelineCreateInfo& pipeline_info = create_info.pipeline_info;
+    pipeline_info.stageCount = 0;
+    pipeline_info.pStages = nullptr;
+
+    switch (part_) {
+        case VERTEX_INPUT: {
+            library_info.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+            break;
+        }
+        case PRE_RASTERIZATION: {
+            library_info.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+            pipeline_info.stageCount = 1;
+            pipeline_info.pStages = &create_info.shader_stages[0];
+            break;
+        }
+        case FRAGMENT_SHADER: {
+            library_info.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+            pipeline_info.stageCount = 1;
+            pipeline_info.pStages = &create_info.shader_stages[1];
+            break;
+        }
+        case FRAGMENT_OUTPUT: {
+            library_info.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+            break;
+        }
+        default: {
+            throw std::runtime_error("Unknown graphics pipeline library part!");
+        }
+    }
+
+    // Retaining the link time optimization info is what allows linking an optimized pipeline later.
+    pipeline_info.pNext = &library_info;
+    pipeline_info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    if (vkCreateGraphicsPipelines(device_->GetLogicalDevice(), device_->GetPipelineCache().GetPipelineCache(), 1, &pipeline_info, nullptr, &pipeline_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline library!");
+    }
+}
+
+ComputePipeline::ComputePipeline(std::shared_ptr<Device> device, std::shared_ptr<Shader> compute_shader) :
+    Pipeline{ device },
+    compute_shader_{ compute_shader }
+{
+    Create();
+}
+
+void ComputePipeline::CreatePipelineLayout() {
+    pipeline_layout_ = device_->GetLayoutCache().GetPipelineLayout(compute_shader_->GetParameterLayouts());
 }
 
 void ComputePipeline::CreatePipeline() {
@@ -225,11 +487,14 @@ void ComputePipeline::CreatePipeline() {
 
     VkComputePipelineCreateInfo pipeline_info = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .flags = GetCreationFlags(),
         .stage = compute_stage_info,
-        .layout = pipeline_layout_,
+        .layout = pipeline_layout_->GetLayout(),
     };
 
-    vkCreateComputePipelines(device_->GetLogicalDevice(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    if (vkCreateComputePipelines(device_->GetLogicalDevice(), device_->GetPipelineCache().GetPipelineCache(), 1, &pipeline_info, nullptr, &pipeline_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline!");
+    }
 }
 
 void ComputePipeline::DispatchCompute(CommandBuffer command_buffer, uint32_t group_width, uint32_t group_height, uint32_t group_depth) {
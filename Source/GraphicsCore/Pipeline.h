@@ -1,10 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
 #include "Command.h"
+#include "LayoutCache.h"
 #include "Parameters.h"
 #include "Shader.h"
 
@@ -13,15 +16,10 @@ class Pipeline {
 public:
     Pipeline(std::shared_ptr<Device> device) : 
         device_{ device },
-        pipeline_layout_{ VK_NULL_HANDLE },
         pipeline_{ VK_NULL_HANDLE }
     {}
 
     virtual ~Pipeline() {
-        if (pipeline_layout_ != VK_NULL_HANDLE) {
-            vkDestroyPipelineLayout(device_->GetLogicalDevice(), pipeline_layout_, nullptr);
-        }
-
         if (pipeline_ != VK_NULL_HANDLE) {
             vkDestroyPipeline(device_->GetLogicalDevice(), pipeline_, nullptr);
         }
@@ -29,7 +27,12 @@ public:
 
     virtual inline VkPipelineBindPoint GetBindPoint() const = 0;
 
-    inline VkPipelineLayout GetPipelineLayout() const {return pipeline_layout_;}
+    inline VkPipeline GetPipeline() const {return pipeline_;}
+    inline VkPipelineLayout GetPipelineLayout() const {return pipeline_layout_->GetLayout();}
+    // Pipelines with identical layouts share them, see PipelineLayout::IsCompatibleForSet().
+    inline std::shared_ptr<PipelineLayout> GetLayout() const {return pipeline_layout_;}
+    // Descriptor sets bound to the pipeline have to be allocated with these layouts.
+    inline const std::vector<std::shared_ptr<DescriptorSetLayout>>& GetParameterLayouts() const {return pipeline_layout_->GetSetLayouts();}
 
     void Bind(CommandBuffer command_buffer) {
         command_buffer.Record([&](VkCommandBuffer command) {
@@ -47,7 +50,11 @@ public:
 protected:
     std::shared_ptr<Device> device_;
     VkPipeline pipeline_;
-    VkPipelineLayout pipeline_layout_;
+    std::shared_ptr<PipelineLayout> pipeline_layout_;
+
+    VkPipelineCreateFlags GetCreationFlags() const {
+        return device_->UsesDescriptorBuffers() ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+    }
 
     void Create() {
         static_cast<Derived*>(this)->CreatePipelineLayout();
@@ -55,6 +62,8 @@ protected:
     }
 };
 
+class GraphicsPipelineLibrary;
+
 class GraphicsPipeline : public Pipeline<GraphicsPipeline> {
 public:
     friend class Pipeline<GraphicsPipeline>;
@@ -63,22 +72,126 @@ public:
         std::vector<VkFormat> color_formats;
         VkFormat depth_format = VK_FORMAT_UNDEFINED;
         VkFormat stencil_format = VK_FORMAT_UNDEFINED;
+
+        bool operator==(const AttachmentFormats& other) const = default;
     };
 
     // This may include more in the future, e.g. geometry shaders.
     struct ShaderStages {
         std::shared_ptr<Shader> vertex_shader;
         std::shared_ptr<Shader> fragment_shader;
+
+        bool operator==(const ShaderStages& other) const = default;
+    };
+
+    // An attribute in a vertex buffer, which feeds the shader input with the same semantic (ignoring case).
+    struct VertexAttribute {
+        std::string semantic;
+        // How the attribute is stored, e.g. R16G16_UNORM or A2B10G10R10_SNORM_PACK32 for quantized data, as long as
+        // it converts to what the shader reads. Undefined means the shader's own format.
+        VkFormat format = VK_FORMAT_UNDEFINED;
+
+        bool operator==(const VertexAttribute& other) const = default;
+    };
+
+    // The attributes of a stream are packed one after the other, in the order given. Attributes the shader doesn't
+    // read just take up space, so the same buffers can be used by shaders that read less of them.
+    struct VertexStream {
+        std::vector<VertexAttribute> attributes;
+        VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        bool operator==(const VertexStream& other) const = default;
+    };
+
+    // The fixed-function state baked into the pipeline. Viewport and scissor are always dynamic.
+    struct State {
+        // Stream i is read from vertex buffer binding i. Without any streams, all of the vertex shader's inputs
+        // are read interleaved from binding 0, in location order and in the formats the shader reads.
+        std::vector<VertexStream> vertex_streams;
+
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+        VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+        VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT;
+
+        VkBool32 depth_test_enable = VK_FALSE;
+        VkBool32 depth_write_enable = VK_TRUE;
+        VkCompareOp depth_compare_op = VK_COMPARE_OP_LESS;
+
+        // The same blending is used for every color attachment.
+        VkBool32 blend_enable = VK_FALSE;
+        VkBlendFactor src_color_blend_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+        VkBlendFactor dst_color_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        VkBlendOp color_blend_op = VK_BLEND_OP_ADD;
+        VkBlendFactor src_alpha_blend_factor = VK_BLEND_FACTOR_ONE;
+        VkBlendFactor dst_alpha_blend_factor = VK_BLEND_FACTOR_ZERO;
+        VkBlendOp alpha_blend_op = VK_BLEND_OP_ADD;
+        VkColorComponentFlags color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+        bool operator==(const State& other) const = default;
     };
 
+    // Compiles the pipeline right away, see PipelineStateCache for compiling in the background.
     GraphicsPipeline(std::shared_ptr<Device> device, ShaderStages shaders, const AttachmentFormats& attachment_formats);
+    GraphicsPipeline(std::shared_ptr<Device> device, ShaderStages shaders, const AttachmentFormats& attachment_formats, const State& state);
+    // Links one library of every part, in the order of GraphicsPipelineLibrary::Part. That only takes the driver
+    // microseconds, unless the pipeline is optimized, which takes about as long as compiling it directly.
+    GraphicsPipeline(std::shared_ptr<Device> device, const std::vector<std::shared_ptr<GraphicsPipelineLibrary>>& libraries, bool is_optimized);
     virtual ~GraphicsPipeline() = default;
 
     virtual inline VkPipelineBindPoint GetBindPoint() const override {return VK_PIPELINE_BIND_POINT_GRAPHICS;}
 
+    // The layout of a pipeline with these shaders, with the parameters of both stages merged set by set.
+    static std::shared_ptr<PipelineLayout> GetMergedLayout(std::shared_ptr<Device> device, const ShaderStages& shaders);
+    // How the vertex streams feed the shader's inputs, see State::vertex_streams.
+    static void GetVertexInputDescriptions(const std::vector<Shader::VertexInput>& vertex_inputs, const std::vector<VertexStream>& vertex_streams,
+                                           std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes);
+
 private:
     ShaderStages shaders_;
     AttachmentFormats attachment_formats_;
+    State state_;
+
+    std::vector<std::shared_ptr<GraphicsPipelineLibrary>> libraries_;
+    bool is_optimized_;
+
+    void CreatePipelineLayout();
+    void CreatePipeline();
+};
+
+// One of the four parts of a graphics pipeline, compiled on its own with VK_EXT_graphics_pipeline_library, so that
+// pipelines which only differ in their other parts can share it and are quick to link, see PipelineStateCache.
+// A part only depends on some of the pipeline's description, the rest is ignored by the driver.
+class GraphicsPipelineLibrary : public Pipeline<GraphicsPipelineLibrary> {
+public:
+    friend class Pipeline<GraphicsPipelineLibrary>;
+
+    enum Part {
+        // The vertex streams (and the vertex shader's inputs) and topology.
+        VERTEX_INPUT,
+        // The vertex shader, pipeline layout and rasterization state.
+        PRE_RASTERIZATION,
+        // The fragment shader, pipeline layout, depth state and sample count.
+        FRAGMENT_SHADER,
+        // The attachment formats, blending and sample count.
+        FRAGMENT_OUTPUT,
+        MAX_PARTS,
+    };
+
+    GraphicsPipelineLibrary(std::shared_ptr<Device> device, Part part, GraphicsPipeline::ShaderStages shaders,
+                            const GraphicsPipeline::AttachmentFormats& attachment_formats, const GraphicsPipeline::State& state);
+    virtual ~GraphicsPipelineLibrary() = default;
+
+    virtual inline VkPipelineBindPoint GetBindPoint() const override {return VK_PIPELINE_BIND_POINT_GRAPHICS;}
+
+    inline Part GetPart() const {return part_;}
+
+private:
+    Part part_;
+    GraphicsPipeline::ShaderStages shaders_;
+    GraphicsPipeline::AttachmentFormats attachment_formats_;
+    GraphicsPipeline::State state_;
 
     void CreatePipelineLayout();
     void CreatePipeline();
@@ -0,0 +1,152 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#include "../CoreUtility/Hash.h"
+#include "Device.h"
+#include "Utility.h"
+
+DEFINE_LOGGER(LogPipelineCache, Logger::SeverityLevel::INFO);
+
+// The driver's data is prefixed with our own small header, so a truncated or corrupted file is caught
+// before the driver sees it. Not every driver copes well with garbage in the initial data.
+static constexpr uint32_t CACHE_MAGIC = 0x43505350; // "PSPC"
+static constexpr uint32_t CACHE_VERSION = 1;
+
+struct CacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_size;
+    uint64_t data_hash;
+};
+
+std::filesystem::path PipelineCache::GetDefaultPath() {
+    return std::filesystem::path{ PIPELINE_CACHE_DIRECTORY } / "pipeline_cache.bin";
+}
+
+PipelineCache::PipelineCache(Device& device, const std::filesystem::path& cache_path) :
+    device_{ device },
+    cache_path_{ cache_path },
+    pipeline_cache_{ VK_NULL_HANDLE }
+{
+    std::vector<char> cache_data = Load();
+
+    VkPipelineCacheCreateInfo cache_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = cache_data.size(),
+        .pInitialData = cache_data.data(),
+    };
+
+    if (vkCreatePipelineCache(device_.GetLogicalDevice(), &cache_info, nullptr, &pipeline_cache_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+
+    LOG(LogPipelineCache, Logger::SeverityLevel::INFO, "Loaded {0} bytes of pipeline cache from {1}", cache_data.size(), cache_path_.string());
+}
+
+PipelineCache::~PipelineCache() {
+    Save();
+    vkDestroyPipelineCache(device_.GetLogicalDevice(), pipeline_cache_, nullptr);
+}
+
+void PipelineCache::Save() const {
+    size_t data_size = 0;
+    if (vkGetPipelineCacheData(device_.GetLogicalDevice(), pipeline_cache_, &data_size, nullptr) != VK_SUCCESS) {
+        return;
+    }
+
+    std::vector<char> cache_data(data_size);
+    if (vkGetPipelineCacheData(device_.GetLogicalDevice(), pipeline_cache_, &data_size, cache_data.data()) != VK_SUCCESS) {
+        return;
+    }
+    cache_data.resize(data_size);
+
+    std::error_code error;
+    std::filesystem::create_directories(cache_path_.parent_path(), error);
+    if (error) {
+        LOG(LogPipelineCache, Logger::SeverityLevel::WARN, "Failed to create pipeline cache directory {0}: {1}", cache_path_.parent_path().string(), error.message());
+        return;
+    }
+
+    // Written to a temporary file first and then renamed, so that a crash or another process
+    // starting up never sees a partially written cache.
+    std::filesystem::path temporary_path = cache_path_;
+    temporary_path += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    {
+        CacheFileHeader header = {
+            .magic = CACHE_MAGIC,
+            .version = CACHE_VERSION,
+            .data_size = cache_data.size(),
+            .data_hash = HashBytes(cache_data.data(), cache_data.size()),
+        };
+
+        std::ofstream file{ temporary_path, std::ios::binary | std::ios::trunc };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(cache_data.data(), cache_data.size());
+
+        if (!file.good()) {
+            error = std::make_error_code(std::errc::io_error);
+        }
+    }
+
+    if (!error) {
+        std::filesystem::rename(temporary_path, cache_path_, error);
+    }
+
+    if (error) {
+        LOG(LogPipelineCache, Logger::SeverityLevel::WARN, "Failed to write pipeline cache {0}: {1}", cache_path_.string(), error.message());
+        std::filesystem::remove(temporary_path, error);
+        return;
+    }
+
+    LOG(LogPipelineCache, Logger::SeverityLevel::INFO, "Saved {0} bytes of pipeline cache to {1}", cache_data.size(), cache_path_.string());
+}
+
+std::vector<char> PipelineCache::Load() const {
+    std::ifstream file{ cache_path_, std::ios::binary };
+    if (!file) {
+        return {};
+    }
+
+    CacheFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file.good() || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+        LOG(LogPipelineCache, Logger::SeverityLevel::WARN, "Ignoring pipeline cache {0}, unknown format", cache_path_.string());
+        return {};
+    }
+
+    std::vector<char> cache_data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    if (cache_data.size() != header.data_size || HashBytes(cache_data.data(), cache_data.size()) != header.data_hash) {
+        LOG(LogPipelineCache, Logger::SeverityLevel::WARN, "Ignoring pipeline cache {0}, it is corrupt", cache_path_.string());
+        return {};
+    }
+
+    if (!IsCompatible(cache_data)) {
+        // Expected after a driver update or when switching GPUs, the cache is just rebuilt.
+        LOG(LogPipelineCache, Logger::SeverityLevel::INFO, "Ignoring pipeline cache {0}, it was written by a different device or driver", cache_path_.string());
+        return {};
+    }
+
+    return cache_data;
+}
+
+bool PipelineCache::IsCompatible(const std::vector<char>& cache_data) const {
+    VkPipelineCacheHeaderVersionOne cache_header;
+    if (cache_data.size() < sizeof(cache_header)) {
+        return false;
+    }
+    std::memcpy(&cache_header, cache_data.data(), sizeof(cache_header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device_.GetPhysicalDevice(), &properties);
+
+    return cache_header.headerSize >= sizeof(cache_header) && cache_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           cache_header.vendorID == properties.vendorID && cache_header.deviceID == properties.deviceID &&
+           std::memcmp(cache_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+class Device;
+
+// The driver's VkPipelineCache, kept on disk between runs, so pipelines that were created before
+// don't have to be compiled by the driver again. The data on disk is only handed to the driver if it was
+// written by the same driver and device (vendor, device and cache UUID in the header), and if it is intact.
+// Every pipeline the device creates goes through it, and it is saved when the device is destroyed.
+class PipelineCache {
+public:
+    // Where devices keep their cache, within the build directory.
+    static std::filesystem::path GetDefaultPath();
+
+    PipelineCache(Device& device, const std::filesystem::path& cache_path);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    inline VkPipelineCache GetPipelineCache() const {return pipeline_cache_;}
+    inline const std::filesystem::path& GetPath() const {return cache_path_;}
+
+    // Failing to save isn't an error, pipelines will just be compiled again next time.
+    void Save() const;
+
+private:
+    Device& device_;
+    std::filesystem::path cache_path_;
+    VkPipelineCache pipeline_cache_;
+
+    std::vector<char> Load() const;
+    bool IsCompatible(const std::vector<char>& cache_data) const;
+};
@@ -0,0 +1,274 @@
+#include "PipelineStateCache.h"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+#include "../CoreUtility/Hash.h"
+
+static uint64_t HashVertexInput(const GraphicsPipeline::State& state, uint64_t hash) {
+    hash = HashValue(state.vertex_streams.size(), hash);
+    for (const GraphicsPipeline::VertexStream& vertex_stream : state.vertex_streams) {
+        hash = HashValue(vertex_stream.attributes.size(), hash);
+        for (const GraphicsPipeline::VertexAttribute& vertex_attribute : vertex_stream.attributes) {
+            hash = HashString(vertex_attribute.semantic, hash);
+            hash = HashValue(vertex_attribute.format, hash);
+        }
+        hash = HashValue(vertex_stream.input_rate, hash);
+    }
+    return HashValue(state.topology, hash);
+}
+
+static uint64_t HashRasterization(const GraphicsPipeline::State& state, uint64_t hash) {
+    hash = HashValue(state.polygon_mode, hash);
+    hash = HashValue(state.cull_mode, hash);
+    return HashValue(state.front_face, hash);
+}
+
+static uint64_t HashDepth(const GraphicsPipeline::State& state, uint64_t hash) {
+    hash = HashValue(state.depth_test_enable, hash);
+    hash = HashValue(state.depth_write_enable, hash);
+    return HashValue(state.depth_compare_op, hash);
+}
+
+static uint64_t HashFragmentOutput(const GraphicsPipeline::AttachmentFormats& attachment_formats, const GraphicsPipeline::State& state, uint64_t hash) {
+    hash = HashValue(attachment_formats.color_formats.size(), hash);
+    for (VkFormat color_format : attachment_formats.color_formats) {
+        hash = HashValue(color_format, hash);
+    }
+    hash = HashValue(attachment_formats.depth_format, hash);
+    hash = HashValue(attachment_formats.stencil_format, hash);
+
+    hash = HashValue(state.blend_enable, hash);
+    hash = HashValue(state.src_color_blend_factor, hash);
+    hash = HashValue(state.dst_color_blend_factor, hash);
+    hash = HashValue(state.color_blend_op, hash);
+    hash = HashValue(state.src_alpha_blend_factor, hash);
+    hash = HashValue(state.dst_alpha_blend_factor, hash);
+    hash = HashValue(state.alpha_blend_op, hash);
+    return HashValue(state.color_write_mask, hash);
+}
+
+// Shaders are hashed by identity, the entry holds on to them so their addresses can't be reused.
+static uint64_t HashGraphicsDesc(const PipelineStateCache::GraphicsDesc& graphics_desc) {
+    uint64_t hash = HashValue(graphics_desc.shaders.vertex_shader.get());
+    hash = HashValue(graphics_desc.shaders.fragment_shader.get(), hash);
+    hash = HashVertexInput(graphics_desc.state, hash);
+    hash = HashRasterization(graphics_desc.state, hash);
+    hash = HashDepth(graphics_desc.state, hash);
+    hash = HashValue(graphics_desc.state.sample_count, hash);
+    return HashFragmentOutput(graphics_desc.attachment_formats, graphics_desc.state, hash);
+}
+
+// Only hashes what the part depends on, see GraphicsPipelineLibrary::Part.
+static uint64_t HashLibrary(GraphicsPipelineLibrary::Part part, const PipelineStateCache::GraphicsDesc& graphics_desc, const PipelineLayout* layout) {
+    uint64_t hash = HashValue(part);
+    const GraphicsPipeline::State& state = graphics_desc.state;
+
+    switch (part) {
+        case GraphicsPipelineLibrary::VERTEX_INPUT: {
+            // The vertex shader's inputs decide which attributes are read.
+            hash = HashValue(graphics_desc.shaders.vertex_shader.get(), hash);
+            return HashVertexInput(state, hash);
+        }
+        case GraphicsPipelineLibrary::PRE_RASTERIZATION: {
+            hash = HashValue(graphics_desc.shaders.vertex_shader.get(), hash);
+            hash = HashValue(layout, hash);
+            return HashRasterization(state, hash);
+        }
+        case GraphicsPipelineLibrary::FRAGMENT_SHADER: {
+            hash = HashValue(graphics_desc.shaders.fragment_shader.get(), hash);
+            hash = HashValue(layout, hash);
+            hash = HashValue(state.sample_count, hash);
+            return HashDepth(state, hash);
+        }
+        case GraphicsPipelineLibrary::FRAGMENT_OUTPUT: {
+            hash = HashValue(state.sample_count, hash);
+            return HashFragmentOutput(graphics_desc.attachment_formats, state, hash);
+        }
+        default: {
+            return hash;
+        }
+    }
+}
+
+static bool IsSameLibrary(GraphicsPipelineLibrary::Part part, const PipelineStateCache::GraphicsDesc& first_desc, const PipelineLayout* first_layout,
+                          const PipelineStateCache::GraphicsDesc& second_desc, const PipelineLayout* second_layout) {
+    const GraphicsPipeline::State& first = first_desc.state;
+    const GraphicsPipeline::State& second = second_desc.state;
+
+    switch (part) {
+        case GraphicsPipelineLibrary::VERTEX_INPUT: {
+            return first_desc.shaders.vertex_shader == second_desc.shaders.vertex_shader &&
+                   first.vertex_streams == second.vertex_streams && first.topology == second.topology;
+        }
+        case GraphicsPipelineLibrary::PRE_RASTERIZATION: {
+            return first_desc.shaders.vertex_shader == second_desc.shaders.vertex_shader && first_layout == second_layout &&
+                   first.polygon_mode == second.polygon_mode && first.cull_mode == second.cull_mode && first.front_face == second.front_face;
+        }
+        case GraphicsPipelineLibrary::FRAGMENT_SHADER: {
+            return first_desc.shaders.fragment_shader == second_desc.shaders.fragment_shader && first_layout == second_layout &&
+                   first.sample_count == second.sample_count && first.depth_test_enable == second.depth_test_enable &&
+                   first.depth_write_enable == second.depth_write_enable && first.depth_compare_op == second.depth_compare_op;
+        }
+        case GraphicsPipelineLibrary::FRAGMENT_OUTPUT: {
+            return first_desc.attachment_formats == second_desc.attachment_formats && first.sample_count == second.sample_count &&
+                   first.blend_enable == second.blend_enable && first.src_color_blend_factor == second.src_color_blend_factor &&
+                   first.dst_color_blend_factor == second.dst_color_blend_factor && first.color_blend_op == second.color_blend_op &&
+                   first.src_alpha_blend_factor == second.src_alpha_blend_factor && first.dst_alpha_blend_factor == second.dst_alpha_blend_factor &&
+                   first.alpha_blend_op == second.alpha_blend_op && first.color_write_mask == second.color_write_mask;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static std::shared_ptr<GraphicsPipeline> LinkLibraries(std::shared_ptr<Device> device, const std::vector<std::shared_future<std::shared_ptr<GraphicsPipelineLibrary>>>& library_futures, bool is_optimized) {
+    std::vector<std::shared_ptr<GraphicsPipelineLibrary>> libraries;
+    for (const std::shared_future<std::shared_ptr<GraphicsPipelineLibrary>>& library_future : library_futures) {
+        libraries.push_back(library_future.get());
+    }
+    return std::make_shared<GraphicsPipeline>(device, libraries, is_optimized);
+}
+
+PipelineStateCache::PipelineStateCache(std::shared_ptr<Device> device, uint32_t num_worker_threads) :
+    device_{ device },
+    num_hits_{ 0 },
+    num_misses_{ 0 },
+    num_worker_threads_{ num_worker_threads }
+{}
+
+PipelineHandle<GraphicsPipeline> PipelineStateCache::GetGraphicsPipeline(const GraphicsDesc& graphics_desc, const GraphicsDesc* fallback_desc) {
+    uint64_t hash = HashGraphicsDesc(graphics_desc);
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    if (const GraphicsEntry* entry = FindGraphicsEntry(hash, graphics_desc)) {
+        num_hits_++;
+        return PipelineHandle<GraphicsPipeline>{ entry->compilation };
+    }
+
+    auto compilation = std::make_shared<PipelineHandle<GraphicsPipeline>::Compilation>();
+    if (device_->IsGraphicsPipelineLibrarySupported()) {
+        LinkGraphicsPipeline(graphics_desc, *compilation);
+    } else {
+        compilation->pipeline = GetThreadPool().Submit([device = device_, graphics_desc](uint32_t) {
+            return std::make_shared<GraphicsPipeline>(device, graphics_desc.shaders, graphics_desc.attachment_formats, graphics_desc.state);
+        }).share();
+    }
+
+    if (fallback_desc != nullptr) {
+        if (const GraphicsEntry* fallback_entry = FindGraphicsEntry(HashGraphicsDesc(*fallback_desc), *fallback_desc)) {
+            compilation->fallback = fallback_entry->compilation;
+        }
+    }
+    num_misses_++;
+
+    graphics_entries_[hash].push_back(GraphicsEntry{graphics_desc, compilation});
+    return PipelineHandle<GraphicsPipeline>{ compilation };
+}
+
+PipelineHandle<ComputePipeline> PipelineStateCache::GetComputePipeline(std::shared_ptr<Shader> compute_shader) {
+    uint64_t hash = HashValue(compute_shader.get());
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    std::vector<ComputeEntry>& entries = compute_entries_[hash];
+    for (const ComputeEntry& entry : entries) {
+        if (entry.desc == compute_shader) {
+            num_hits_++;
+            return PipelineHandle<ComputePipeline>{ entry.compilation };
+        }
+    }
+
+    auto compilation = std::make_shared<PipelineHandle<ComputePipeline>::Compilation>();
+    compilation->pipeline = GetThreadPool().Submit([device = device_, compute_shader](uint32_t) {
+        return std::make_shared<ComputePipeline>(device, compute_shader);
+    }).share();
+    num_misses_++;
+
+    entries.push_back(ComputeEntry{compute_shader, compilation});
+    return PipelineHandle<ComputePipeline>{ compilation };
+}
+
+ThreadPool& PipelineStateCache::GetThreadPool() {
+    // Only called with the mutex held.
+    if (thread_pool_ == nullptr) {
+        thread_pool_ = std::make_unique<ThreadPool>(num_worker_threads_);
+    }
+    return *thread_pool_;
+}
+
+const PipelineStateCache::GraphicsEntry* PipelineStateCache::FindGraphicsEntry(uint64_t hash, const GraphicsDesc& graphics_desc) const {
+    auto it = graphics_entries_.find(hash);
+    if (it == graphics_entries_.end()) {
+        return nullptr;
+    }
+
+    for (const GraphicsEntry& entry : it->second) {
+        if (entry.desc == graphics_desc) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void PipelineStateCache::LinkGraphicsPipeline(const GraphicsDesc& graphics_desc, PipelineHandle<GraphicsPipeline>::Compilation& compilation) {
+    using LibraryPromise = std::promise<std::shared_ptr<GraphicsPipelineLibrary>>;
+
+    std::shared_ptr<PipelineLayout> layout = GraphicsPipeline::GetMergedLayout(device_, graphics_desc.shaders);
+
+    std::vector<std::shared_future<std::shared_ptr<GraphicsPipelineLibrary>>> libraries;
+    // Parts that haven't been asked for before are compiled by the task that links the pipeline.
+    std::vector<std::pair<GraphicsPipelineLibrary::Part, std::shared_ptr<LibraryPromise>>> missing_libraries;
+    bool are_libraries_ready = true;
+
+    for (uint32_t part_index = 0; part_index < GraphicsPipelineLibrary::MAX_PARTS; part_index++) {
+        auto part = static_cast<GraphicsPipelineLibrary::Part>(part_index);
+
+        std::vector<LibraryEntry>& entries = library_entries_[HashLibrary(part, graphics_desc, layout.get())];
+        auto entry = std::find_if(entries.begin(), entries.end(), [&](const LibraryEntry& other) {
+            return other.part == part && IsSameLibrary(part, other.desc, other.layout.get(), graphics_desc, layout.get());
+        });
+
+        if (entry == entries.end()) {
+            auto promise = std::make_shared<LibraryPromise>();
+            entries.push_back(LibraryEntry{part, graphics_desc, layout, promise->get_future().share()});
+            missing_libraries.emplace_back(part, promise);
+            entry = std::prev(entries.end());
+        }
+
+        libraries.push_back(entry->library);
+        are_libraries_ready = are_libraries_ready && IsFutureReady(entry->library);
+    }
+
+    auto link = [device = device_, graphics_desc, libraries, missing_libraries](uint32_t) {
+        for (const auto& [part, promise] : missing_libraries) {
+            try {
+                promise->set_value(std::make_shared<GraphicsPipelineLibrary>(device, part, graphics_desc.shaders, graphics_desc.attachment_formats, graphics_desc.state));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        }
+        return LinkLibraries(device, libraries, false);
+    };
+
+    if (are_libraries_ready) {
+        // Only new combinations of parts that were compiled before, linking them is cheap enough to do right away.
+        std::promise<std::shared_ptr<GraphicsPipeline>> pipeline;
+        try {
+            pipeline.set_value(link(0));
+        } catch (...) {
+            pipeline.set_exception(std::current_exception());
+        }
+        compilation.pipeline = pipeline.get_future().share();
+    } else {
+        compilation.pipeline = GetThreadPool().Submit(link).share();
+    }
+
+    // Tasks are started in the order they are submitted, and whichever task compiles a library was submitted before
+    // any task that waits for it, so the workers never wait for a task that no worker is running.
+    compilation.optimized_pipeline = GetThreadPool().Submit([device = device_, libraries](uint32_t) {
+        return LinkLibraries(device, libraries, true);
+    }).share();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../CoreUtility/ThreadPool.h"
+#include "Device.h"
+#include "Pipeline.h"
+
+template<typename T> bool IsFutureReady(const std::shared_future<T>& future) {
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// A pipeline that may still be compiling. Cheap to copy, all copies refer to the same compilation.
+template<typename PipelineType>
+class PipelineHandle {
+public:
+    struct Compilation {
+        std::shared_future<std::shared_ptr<PipelineType>> pipeline;
+        // If the pipeline is optimized in the background, this replaces it once it's done.
+        std::shared_future<std::shared_ptr<PipelineType>> optimized_pipeline;
+        // Used while the pipeline is compiling, if there is one.
+        std::shared_ptr<const Compilation> fallback;
+    };
+
+    PipelineHandle() = default;
+    PipelineHandle(std::shared_ptr<const Compilation> compilation) : compilation_{ compilation } {}
+
+    inline bool IsValid() const {return compilation_ != nullptr;}
+
+    bool IsReady() const {
+        return compilation_ != nullptr && IsFutureReady(compilation_->pipeline);
+    }
+
+    // The pipeline if it is done compiling (the optimized one if that is done too), otherwise whatever its fallback
+    // has to offer, or null. Doesn't block, so it can be called while recording a frame. Compilation errors are rethrown here.
+    std::shared_ptr<PipelineType> Get() const {
+        for (const Compilation* compilation = compilation_.get(); compilation != nullptr; compilation = compilation->fallback.get()) {
+            if (IsFutureReady(compilation->optimized_pipeline)) {
+                return compilation->optimized_pipeline.get();
+            }
+            if (IsFutureReady(compilation->pipeline)) {
+                return compilation->pipeline.get();
+            }
+        }
+        return nullptr;
+    }
+
+    // Blocks until the pipeline itself is compiled, but not until it is optimized.
+    std::shared_ptr<PipelineType> Wait() const {
+        if (IsFutureReady(compilation_->optimized_pipeline)) {
+            return compilation_->optimized_pipeline.get();
+        }
+        return compilation_->pipeline.get();
+    }
+
+    // Blocks until the pipeline is in its final form.
+    std::shared_ptr<PipelineType> WaitOptimized() const {
+        if (compilation_->optimized_pipeline.valid()) {
+            return compilation_->optimized_pipeline.get();
+        }
+        return compilation_->pipeline.get();
+    }
+
+private:
+    std::shared_ptr<const Compilation> compilation_;
+};
+
+// Pipelines looked up by everything they are created from, so each variant is only ever compiled once.
+// A variant that hasn't been asked for before is compiled on a worker thread, and the caller gets a handle
+// right away instead of waiting for the driver, optionally falling back to another variant in the meantime.
+// Pipelines are kept for as long as the cache lives.
+// Where the device supports graphics pipeline libraries, graphics pipelines are linked from separately compiled
+// parts instead (see GraphicsPipelineLibrary), which are shared by all pipelines they are the same in. A variant
+// whose parts all exist is linked right away on the calling thread, which takes microseconds, and an optimized
+// version of it is linked in the background and replaces it once it's done.
+class PipelineStateCache {
+public:
+    struct GraphicsDesc {
+        GraphicsPipeline::ShaderStages shaders;
+        GraphicsPipeline::AttachmentFormats attachment_formats;
+        GraphicsPipeline::State state;
+
+        bool operator==(const GraphicsDesc& other) const = default;
+    };
+
+    // The worker threads are only started once something has to be compiled.
+    PipelineStateCache(std::shared_ptr<Device> device, uint32_t num_worker_threads = std::max(std::thread::hardware_concurrency() / 2, 1u));
+    ~PipelineStateCache() = default;
+
+    PipelineStateCache(const PipelineStateCache&) = delete;
+    PipelineStateCache& operator=(const PipelineStateCache&) = delete;
+
+    // The fallback is only used until the pipeline is ready, and only if it has been requested before
+    // (it isn't compiled just to serve as a fallback).
+    PipelineHandle<GraphicsPipeline> GetGraphicsPipeline(const GraphicsDesc& graphics_desc, const GraphicsDesc* fallback_desc = nullptr);
+    PipelineHandle<ComputePipeline> GetComputePipeline(std::shared_ptr<Shader> compute_shader);
+
+    inline uint64_t GetNumHits() const {return num_hits_;}
+    inline uint64_t GetNumMisses() const {return num_misses_;}
+
+private:
+    template<typename Desc, typename PipelineType> struct Entry {
+        Desc desc;
+        std::shared_ptr<const typename PipelineHandle<PipelineType>::Compilation> compilation;
+    };
+    using GraphicsEntry = Entry<GraphicsDesc, GraphicsPipeline>;
+    using ComputeEntry = Entry<std::shared_ptr<Shader>, ComputePipeline>;
+
+    // A part is looked up by what it depends on, which may be less than the description it was first compiled for.
+    struct LibraryEntry {
+        GraphicsPipelineLibrary::Part part;
+        GraphicsDesc desc;
+        std::shared_ptr<PipelineLayout> layout;
+        std::shared_future<std::shared_ptr<GraphicsPipelineLibrary>> library;
+    };
+
+    std::shared_ptr<Device> device_;
+
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, std::vector<GraphicsEntry>> graphics_entries_;
+    std::unordered_map<uint64_t, std::vector<ComputeEntry>> compute_entries_;
+    std::unordered_map<uint64_t, std::vector<LibraryEntry>> library_entries_;
+
+    uint64_t num_hits_;
+    uint64_t num_misses_;
+
+    // Declared last, so the workers are done before the entries they fill in are destroyed.
+    uint32_t num_worker_threads_;
+    std::unique_ptr<ThreadPool> thread_pool_;
+
+    ThreadPool& GetThreadPool();
+    const GraphicsEntry* FindGraphicsEntry(uint64_t hash, const GraphicsDesc& graphics_desc) const;
+    void LinkGraphicsPipeline(const GraphicsDesc& graphics_desc, PipelineHandle<GraphicsPipeline>::Compilation& compilation);
+};
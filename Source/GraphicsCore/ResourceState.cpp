@@ -0,0 +1,138 @@
+#include "ResourceState.h"
+
+static constexpr VkAccessFlags2 WRITE_ACCESS_FLAGS =
+    VK_ACCESS_2_SHADER_WRITE_BIT |
+    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT |
+    VK_ACCESS_2_HOST_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+ResourceState ResourceState::FromLayout(VkImageLayout layout) {
+    switch (layout) {
+        case VK_IMAGE_LAYOUT_UNDEFINED:
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: {
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, layout};
+        }
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL:
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, layout};
+        }
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: {
+            return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, layout};
+        }
+        default: {
+            // GENERAL and anything else could be used by anything.
+            return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, layout};
+        }
+    }
+}
+
+ResourceStateTracker::ResourceStateTracker(const ResourceState& initial_state) :
+    layout_{ initial_state.layout },
+    queue_family_index_{ initial_state.queue_family_index },
+    write_stages_{ initial_state.stage_flags },
+    write_access_{ initial_state.access_flags & WRITE_ACCESS_FLAGS },
+    read_stages_{ VK_PIPELINE_STAGE_2_NONE },
+    visible_stages_{ initial_state.stage_flags },
+    visible_access_{ initial_state.access_flags }
+{}
+
+std::optional<ResourceStateTracker::Transition> ResourceStateTracker::TransitionTo(const ResourceState& next_state) {
+    bool is_write = (next_state.access_flags & WRITE_ACCESS_FLAGS) != 0;
+    bool is_layout_change = next_state.layout != layout_;
+    bool is_queue_change = (next_state.queue_family_index != VK_QUEUE_FAMILY_IGNORED) &&
+                           (queue_family_index_ != VK_QUEUE_FAMILY_IGNORED) &&
+                           (next_state.queue_family_index != queue_family_index_);
+
+    if (!is_write && !is_layout_change && !is_queue_change) {
+        // Read after read doesn't need any synchronization, and read after write only
+        // has to wait if the write hasn't already been made visible to this kind of read.
+        read_stages_ |= next_state.stage_flags;
+
+        bool is_visible = ((next_state.stage_flags & ~visible_stages_) == 0) &&
+                          ((next_state.access_flags & ~visible_access_) == 0);
+        if (write_stages_ == VK_PIPELINE_STAGE_2_NONE || is_visible) {
+            return std::nullopt;
+        }
+
+        Transition transition = {
+            .source = {write_stages_, write_access_},
+            .destination = {next_state.stage_flags, next_state.access_flags},
+            .old_layout = layout_,
+            .new_layout = layout_,
+        };
+
+        visible_stages_ |= next_state.stage_flags;
+        visible_access_ |= next_state.access_flags;
+        return transition;
+    }
+
+    // Writes and layout transitions have to wait for all earlier accesses. If the resource was
+    // read since the last write, those reads already waited on the write, so only an execution
+    // dependency on the reads is needed (write after read). Otherwise, the last write has to be
+    // made available (write after write).
+    Transition transition = {
+        .old_layout = layout_,
+        .new_layout = next_state.layout,
+    };
+
+    if (read_stages_ != VK_PIPELINE_STAGE_2_NONE) {
+        transition.source = {read_stages_, VK_ACCESS_2_NONE};
+    } else {
+        transition.source = {write_stages_, write_access_};
+    }
+
+    transition.destination = {next_state.stage_flags, next_state.access_flags};
+
+    if (is_queue_change) {
+        transition.source.queue_family_index = queue_family_index_;
+        transition.destination.queue_family_index = next_state.queue_family_index;
+    }
+
+    // A layout transition is a write in itself, which later uses have to wait for.
+    write_stages_ = next_state.stage_flags;
+    write_access_ = next_state.access_flags & WRITE_ACCESS_FLAGS;
+    read_stages_ = is_write ? VK_PIPELINE_STAGE_2_NONE : next_state.stage_flags;
+    visible_stages_ = is_write ? VK_PIPELINE_STAGE_2_NONE : next_state.stage_flags;
+    visible_access_ = is_write ? VK_ACCESS_2_NONE : next_state.access_flags;
+
+    layout_ = next_state.layout;
+    if (next_state.queue_family_index != VK_QUEUE_FAMILY_IGNORED) {
+        queue_family_index_ = next_state.queue_family_index;
+    }
+
+    if (transition.source.stage_flags == VK_PIPELINE_STAGE_2_NONE && !is_layout_change && !is_queue_change) {
+        // Nothing touched the resource before, so there is nothing to wait for.
+        return std::nullopt;
+    }
+
+    return transition;
+}
+
+ResourceState ResourceStateTracker::GetLastAccess() const {
+    return {write_stages_ | read_stages_, write_access_, layout_, queue_family_index_};
+}
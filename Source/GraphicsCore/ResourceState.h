@@ -0,0 +1,63 @@
+#pragma once
+
+#include <optional>
+
+#include <vulkan/vulkan.h>
+
+#include "Resources.h"
+
+// Describes a single use of a resource: the stages that touch it, how they access it,
+// the layout it has to be in (images only) and the queue family that owns it.
+struct ResourceState {
+    VkPipelineStageFlags2 stage_flags = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access_flags = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    uint32_t queue_family_index = VK_QUEUE_FAMILY_IGNORED;
+
+    // Best guess at the stages and accesses that use an image in the given layout.
+    // This is only used where the actual use isn't known, e.g. Image::TransitionImage.
+    static ResourceState FromLayout(VkImageLayout layout);
+};
+
+// Tracks the synchronization state of a single resource across a sequence of uses,
+// and derives the smallest barrier needed between the previous uses and the next one.
+// Reads following a barrier are merged, so that e.g. two consecutive shader reads of
+// the same buffer only wait on the preceding write once.
+class ResourceStateTracker {
+public:
+    struct Transition {
+        ResourceBarrier::AccessInfo source;
+        ResourceBarrier::AccessInfo destination;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+    };
+
+    ResourceStateTracker(const ResourceState& initial_state = {});
+    ~ResourceStateTracker() = default;
+
+    // Moves the resource into the next state. Returns the barrier that has to be recorded
+    // before the next use, or nothing if the resource can be used as is.
+    std::optional<Transition> TransitionTo(const ResourceState& next_state);
+
+    // Everything that has to be waited on before the resource's memory can be reused by
+    // something else, e.g. another resource aliasing the same memory.
+    ResourceState GetLastAccess() const;
+
+    inline VkImageLayout GetLayout() const {return layout_;}
+    inline uint32_t GetQueueFamily() const {return queue_family_index_;}
+
+private:
+    VkImageLayout layout_;
+    uint32_t queue_family_index_;
+
+    // The last write (or layout transition) that later uses have to wait on.
+    VkPipelineStageFlags2 write_stages_;
+    VkAccessFlags2 write_access_;
+
+    // Stages that have read the resource since the last write.
+    VkPipelineStageFlags2 read_stages_;
+
+    // Stages and accesses the last write has already been made visible to.
+    VkPipelineStageFlags2 visible_stages_;
+    VkAccessFlags2 visible_access_;
+};
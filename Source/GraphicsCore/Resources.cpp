@@ -1,4 +1,5 @@
 #include "Resources.h"
+#include "ResourceState.h"
 
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
@@ -18,31 +19,30 @@ Allocator::~Allocator() {
     }
 }
 
-std::shared_ptr<Buffer> Allocator::AllocateBuffer(const Buffer::Desc& buffer_desc) {
+static VkBufferCreateInfo GetBufferCreateInfo(const Buffer::Desc& buffer_desc, const Device& device) {
     VkBufferCreateInfo buffer_info = {
         .sType  = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = buffer_desc.buffer_size,
         .usage = buffer_desc.buffer_usage,
     };
 
+    // Descriptor buffers refer to buffers by their address, which they only have with this usage.
+    const VkBufferUsageFlags descriptor_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT;
+    if (device.UsesDescriptorBuffers() && (buffer_desc.buffer_usage & descriptor_usage)) {
+        buffer_info.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    }
+
     if (!buffer_desc.resource_desc.queue_families.empty()) {
         buffer_info.sharingMode = buffer_desc.resource_desc.sharing_mode;
         buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(buffer_desc.resource_desc.queue_families.size());
         buffer_info.pQueueFamilyIndices = buffer_desc.resource_desc.queue_families.data();
     }
 
-    VmaAllocationCreateInfo alloc_create_info = {
-        .flags = buffer_desc.resource_desc.allocation_flags,
-        .usage = buffer_desc.resource_desc.memory_usage,
-    };
-
-    std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>(buffer_desc);
-    vmaCreateBuffer(allocator_, &buffer_info, &alloc_create_info, &new_buffer->buffer_, &new_buffer->allocation_, nullptr);
-    new_buffer->allocator_ = allocator_;
-    return new_buffer;
+    return buffer_info;
 }
 
-std::shared_ptr<Image> Allocator::AllocateImage(const Image::Desc& image_desc) {
+static VkImageCreateInfo GetImageCreateInfo(const Image::Desc& image_desc) {
     VkImageCreateInfo image_info = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .imageType = VK_IMAGE_TYPE_2D,
@@ -61,6 +61,26 @@ std::shared_ptr<Image> Allocator::AllocateImage(const Image::Desc& image_desc) {
         image_info.pQueueFamilyIndices = image_desc.resource_desc.queue_families.data();
     }
 
+    return image_info;
+}
+
+std::shared_ptr<Buffer> Allocator::AllocateBuffer(const Buffer::Desc& buffer_desc) {
+    VkBufferCreateInfo buffer_info = GetBufferCreateInfo(buffer_desc, *device_);
+
+    VmaAllocationCreateInfo alloc_create_info = {
+        .flags = buffer_desc.resource_desc.allocation_flags,
+        .usage = buffer_desc.resource_desc.memory_usage,
+    };
+
+    std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>(buffer_desc);
+    vmaCreateBuffer(allocator_, &buffer_info, &alloc_create_info, &new_buffer->buffer_, &new_buffer->allocation_, nullptr);
+    new_buffer->allocator_ = allocator_;
+    return new_buffer;
+}
+
+std::shared_ptr<Image> Allocator::AllocateImage(const Image::Desc& image_desc) {
+    VkImageCreateInfo image_info = GetImageCreateInfo(image_desc);
+
     VmaAllocationCreateInfo alloc_create_info = {
         .flags = image_desc.resource_desc.allocation_flags,
         .usage = image_desc.resource_desc.memory_usage,
@@ -68,12 +88,88 @@ std::shared_ptr<Image> Allocator::AllocateImage(const Image::Desc& image_desc) {
 
     std::shared_ptr<Image> new_image = std::make_shared<Image>(image_desc);
     vmaCreateImage(allocator_, &image_info, &alloc_create_info, &new_image->image_, &new_image->allocation_, nullptr);
+    new_image->allocator_ = allocator_;
+    return new_image;
+}
+
+VkMemoryRequirements Allocator::GetBufferMemoryRequirements(const Buffer::Desc& buffer_desc) const {
+    VkBufferCreateInfo buffer_info = GetBufferCreateInfo(buffer_desc, *device_);
+
+    VkDeviceBufferMemoryRequirements requirements_info = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS,
+        .pCreateInfo = &buffer_info,
+    };
+
+    VkMemoryRequirements2 memory_requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+    };
+
+    vkGetDeviceBufferMemoryRequirements(device_->GetLogicalDevice(), &requirements_info, &memory_requirements);
+    return memory_requirements.memoryRequirements;
+}
+
+VkMemoryRequirements Allocator::GetImageMemoryRequirements(const Image::Desc& image_desc) const {
+    VkImageCreateInfo image_info = GetImageCreateInfo(image_desc);
+
+    VkDeviceImageMemoryRequirements requirements_info = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+        .pCreateInfo = &image_info,
+    };
+
+    VkMemoryRequirements2 memory_requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+    };
+
+    vkGetDeviceImageMemoryRequirements(device_->GetLogicalDevice(), &requirements_info, &memory_requirements);
+    return memory_requirements.memoryRequirements;
+}
+
+std::shared_ptr<MemoryBlock> Allocator::AllocateMemoryBlock(const VkMemoryRequirements& memory_requirements) {
+    VmaAllocationCreateInfo alloc_create_info = {
+        .usage = VMA_MEMORY_USAGE_UNKNOWN,
+        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    };
+
+    std::shared_ptr<MemoryBlock> new_block = std::make_shared<MemoryBlock>();
+    if (vmaAllocateMemory(allocator_, &memory_requirements, &alloc_create_info, &new_block->allocation_, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate memory block!");
+    }
+
+    new_block->allocator_ = allocator_;
+    new_block->size_ = memory_requirements.size;
+    return new_block;
+}
+
+std::shared_ptr<Buffer> Allocator::AllocateAliasingBuffer(const Buffer::Desc& buffer_desc, std::shared_ptr<MemoryBlock> memory_block) {
+    VkBufferCreateInfo buffer_info = GetBufferCreateInfo(buffer_desc, *device_);
+
+    std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>(buffer_desc);
+    if (vmaCreateAliasingBuffer(allocator_, memory_block->allocation_, &buffer_info, &new_buffer->buffer_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create aliasing buffer!");
+    }
+
+    new_buffer->allocator_ = allocator_;
+    new_buffer->memory_block_ = memory_block;
+    return new_buffer;
+}
+
+std::shared_ptr<Image> Allocator::AllocateAliasingImage(const Image::Desc& image_desc, std::shared_ptr<MemoryBlock> memory_block) {
+    VkImageCreateInfo image_info = GetImageCreateInfo(image_desc);
+
+    std::shared_ptr<Image> new_image = std::make_shared<Image>(image_desc);
+    if (vmaCreateAliasingImage(allocator_, memory_block->allocation_, &image_info, &new_image->image_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create aliasing image!");
+    }
+
+    new_image->allocator_ = allocator_;
+    new_image->memory_block_ = memory_block;
     return new_image;
 }
 
 void Allocator::CreateAllocator() {
     VmaAllocatorCreateInfo allocator_info = {
-        .flags = VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT,
+        .flags = static_cast<VmaAllocatorCreateFlags>(VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT |
+                 (device_->UsesDescriptorBuffers() ? VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT : 0)),
         .physicalDevice = device_->GetPhysicalDevice(),
         .device = device_->GetLogicalDevice(),
         .instance = instance_->GetInstance(),
@@ -85,6 +181,18 @@ void Allocator::CreateAllocator() {
     }
 }
 
+MemoryBlock::MemoryBlock() :
+    allocator_{ VMA_NULL },
+    allocation_{ VMA_NULL },
+    size_{ 0 }
+{}
+
+MemoryBlock::~MemoryBlock() {
+    if (allocation_ != VMA_NULL) {
+        vmaFreeMemory(allocator_, allocation_);
+    }
+}
+
 Buffer::Buffer(Buffer::Desc buffer_desc) :
     buffer_{ VK_NULL_HANDLE },
     buffer_desc_{ buffer_desc},
@@ -94,6 +202,7 @@ Buffer::Buffer(Buffer::Desc buffer_desc) :
 {}
 
 Buffer::~Buffer() {
+    // Aliasing buffers don't have an allocation of their own, in which case only the buffer is destroyed.
     if (buffer_ != VK_NULL_HANDLE) {
         vmaDestroyBuffer(allocator_, buffer_, allocation_);
     }
@@ -101,6 +210,7 @@ Buffer::~Buffer() {
 
 void* Buffer::MapToCPU() {
     assert(!is_mapped_);
+    assert(allocation_ != VMA_NULL);
     void* data;
     vmaMapMemory(allocator_, allocation_, &data);
     is_mapped_ = true;
@@ -116,38 +226,64 @@ void Buffer::UnmapFromCPU() {
 Image::Image(Image::Desc image_desc) :
     image_{ VK_NULL_HANDLE },
     image_desc_{ image_desc },
-    allocation_{ VMA_NULL }
+    allocation_{ VMA_NULL },
+    allocator_{ VMA_NULL }
 {}
 
 Image::Image(VkImage image, Image::Desc image_desc) :
     image_{ image },
     image_desc_{ image_desc },
-    allocation_{ VMA_NULL }
+    allocation_{ VMA_NULL },
+    allocator_{ VMA_NULL }
 {}
 
-void Image::TransitionImage(CommandBuffer command_buffer, VkImageLayout old_layout, VkImageLayout new_layout) const {
-    VkImageAspectFlags aspect_mask = (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+Image::~Image() {
+    if (image_ != VK_NULL_HANDLE && allocator_ != VMA_NULL) {
+        vmaDestroyImage(allocator_, image_, allocation_);
+    }
+}
+
+VkImageAspectFlags Image::GetAspectFlags() const {
+    switch (image_desc_.image_format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT: {
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        }
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: {
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        case VK_FORMAT_S8_UINT: {
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        default: {
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+}
 
+void Image::TransitionImage(CommandBuffer command_buffer, VkImageLayout old_layout, VkImageLayout new_layout) const {
     VkImageSubresourceRange range = {
-        .aspectMask = aspect_mask,
+        .aspectMask = GetAspectFlags(),
         .baseMipLevel = 0,
         .levelCount = VK_REMAINING_MIP_LEVELS,
         .baseArrayLayer = 0,
         .layerCount = VK_REMAINING_ARRAY_LAYERS,
     };
 
-    ResourceBarrier::AccessInfo source_access = {
-        .stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-        .access_flags = VK_ACCESS_2_MEMORY_WRITE_BIT,
-    };
-
-    ResourceBarrier::AccessInfo destination_access = {
-        .stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-        .access_flags = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT,
-    };
+    // The layouts are all we know about how the image is used before and after, so derive
+    // the stages and accesses from them instead of waiting on all commands.
+    ResourceStateTracker tracker{ ResourceState::FromLayout(old_layout) };
+    std::optional<ResourceStateTracker::Transition> transition = tracker.TransitionTo(ResourceState::FromLayout(new_layout));
+    if (!transition.has_value()) {
+        return;
+    }
 
     ResourceBarrier transition_barrier;
-    transition_barrier.AddImageMemoryBarrier(source_access, destination_access, old_layout, new_layout, *this, range);
+    transition_barrier.AddImageMemoryBarrier(transition->source, transition->destination,
+                                             transition->old_layout, transition->new_layout, *this, range);
     transition_barrier.InsertIntoCommandBuffer(command_buffer);
 }
 
@@ -191,27 +327,31 @@ void ResourceBarrier::AddMemoryBarrier(AccessInfo source, AccessInfo destination
     memory_barriers_.push_back(memory_barrier);
 }
 
-void ResourceBarrier::AddBufferMemoryBarrier(AccessInfo source, AccessInfo destination, Buffer buffer) {
+void ResourceBarrier::AddBufferMemoryBarrier(AccessInfo source, AccessInfo destination, const Buffer& buffer) {
     VkBufferMemoryBarrier2 buffer_barrier = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
         .srcStageMask = source.stage_flags,
         .srcAccessMask = source.access_flags,
         .dstStageMask = destination.stage_flags,
+        .dstAccessMask = destination.access_flags,
         .srcQueueFamilyIndex = source.queue_family_index,
         .dstQueueFamilyIndex = destination.queue_family_index,
-        // todo: finish buffer implementation
+        .buffer = buffer.GetBuffer(),
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
     };
 
     buffer_barriers_.push_back(buffer_barrier);
 }
 
 void ResourceBarrier::AddImageMemoryBarrier(AccessInfo source, AccessInfo destination,
-    VkImageLayout old_layout, VkImageLayout new_layout, Image image, VkImageSubresourceRange range) {
+    VkImageLayout old_layout, VkImageLayout new_layout, const Image& image, VkImageSubresourceRange range) {
     VkImageMemoryBarrier2 image_barrier = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
         .srcStageMask = source.stage_flags,
         .srcAccessMask = source.access_flags,
         .dstStageMask = destination.stage_flags,
+        .dstAccessMask = destination.access_flags,
         .oldLayout = old_layout,
         .newLayout = new_layout,
         .srcQueueFamilyIndex = source.queue_family_index,
@@ -14,6 +14,23 @@ struct ResourceDesc {
     std::vector<uint32_t> queue_families;
 };
 
+// A block of device memory that isn't tied to a single resource. Resources that are never
+// in use at the same time can be placed in the same block to save memory.
+class MemoryBlock {
+public:
+    friend class Allocator;
+
+    MemoryBlock();
+    ~MemoryBlock();
+
+    inline VkDeviceSize GetSize() const {return size_;}
+
+private:
+    VmaAllocator allocator_;
+    VmaAllocation allocation_;
+    VkDeviceSize size_;
+};
+
 class Buffer {
 public:
     struct Desc {
@@ -42,6 +59,9 @@ private:
 
     VmaAllocator allocator_; // Needed for mapping
     bool is_mapped_; // Can only map the memory once at a time.
+
+    // Only set for buffers that alias memory, which is then owned by the block instead of allocation_.
+    std::shared_ptr<MemoryBlock> memory_block_;
 };
 
 class Image {
@@ -59,10 +79,11 @@ public:
     Image(Desc image_desc);
     // This constructor should only be used to wrap images created directly from the swapchain
     Image(VkImage image, Desc image_desc);
-    ~Image() = default; // TODO: fix this
+    ~Image();
 
     inline const VkImage& GetImage() const {return image_;}
     inline const Desc& GetImageDesc() const {return image_desc_;}
+    VkImageAspectFlags GetAspectFlags() const;
 
     void TransitionImage(CommandBuffer command_buffer, VkImageLayout old_layout, VkImageLayout new_layout) const;
 
@@ -70,6 +91,9 @@ private:
     VkImage image_;
     Desc image_desc_;
     VmaAllocation allocation_;
+
+    VmaAllocator allocator_; // Null for swapchain images, which aren't ours to destroy
+    std::shared_ptr<MemoryBlock> memory_block_;
 };
 
 class ImageView {
@@ -113,6 +137,15 @@ public:
     std::shared_ptr<Buffer> AllocateBuffer(const Buffer::Desc& buffer_desc);
     std::shared_ptr<Image> AllocateImage(const Image::Desc& image_desc);
 
+    // For placing several resources in the same memory. Aliasing resources always start at the beginning
+    // of the block, so the block has to satisfy the requirements of all of them, and it's up to the caller
+    // to make sure that resources sharing a block are never used at the same time.
+    VkMemoryRequirements GetBufferMemoryRequirements(const Buffer::Desc& buffer_desc) const;
+    VkMemoryRequirements GetImageMemoryRequirements(const Image::Desc& image_desc) const;
+    std::shared_ptr<MemoryBlock> AllocateMemoryBlock(const VkMemoryRequirements& memory_requirements);
+    std::shared_ptr<Buffer> AllocateAliasingBuffer(const Buffer::Desc& buffer_desc, std::shared_ptr<MemoryBlock> memory_block);
+    std::shared_ptr<Image> AllocateAliasingImage(const Image::Desc& image_desc, std::shared_ptr<MemoryBlock> memory_block);
+
 private:
     std::shared_ptr<Instance> instance_;
     std::shared_ptr<Device> device_;
@@ -135,10 +168,10 @@ public:
     ~ResourceBarrier() = default;
 
     void AddMemoryBarrier(AccessInfo source, AccessInfo destination);
-    void AddBufferMemoryBarrier(AccessInfo source, AccessInfo destination, Buffer buffer);
+    void AddBufferMemoryBarrier(AccessInfo source, AccessInfo destination, const Buffer& buffer);
     void AddImageMemoryBarrier(AccessInfo source, AccessInfo destination,
                                VkImageLayout old_layout, VkImageLayout new_layout, 
-                               Image image, VkImageSubresourceRange range);
+                               const Image& image, VkImageSubresourceRange range);
 
     void InsertIntoCommandBuffer(CommandBuffer command_buffer);
 
@@ -1,166 +1,507 @@
 #include "Shader.h"
 
+#include <algorithm>
+#include <cassert>
+#include <optional>
+
+#include "BindlessHeap.h"
+#include "LayoutCache.h"
+#include "ShaderCache.h"
 #include "Utility.h"
 
-#include <iostream>
 DEFINE_LOGGER(LogShaderCompiler, Logger::SeverityLevel::INFO);
 
-Shader::Shader(std::shared_ptr<Device> device, Slang::ComPtr<slang::IComponentType> program) :
-    device_{ device },
-    shader_module_{ VK_NULL_HANDLE }
-{
-    slang::ProgramLayout* layout = program->getLayout();
-    slang::EntryPointReflection* entry_point = layout->getEntryPointByIndex(0);
-    entry_point_ = entry_point->getName();
+static VkShaderStageFlagBits GetShaderStage(SlangStage stage) {
+    switch (stage) {
+        case SLANG_STAGE_VERTEX: {
+            return VK_SHADER_STAGE_VERTEX_BIT;
+        }
+        case SLANG_STAGE_FRAGMENT: {
+            return VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+        case SLANG_STAGE_COMPUTE: {
+            return VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        default: {
+            throw std::runtime_error("Unsupported shader stage!");
+        }
+    }
+}
 
-    Slang::ComPtr<slang::IBlob> spirv_code;
-    Slang::ComPtr<slang::IBlob> diagnostics;
-    SlangResult result = program->getEntryPointCode(
-        0, 0, spirv_code.writeRef(), diagnostics.writeRef());
+// Parameters that don't take up a descriptor, like push constants, have no descriptor type.
+static std::optional<VkDescriptorType> GetDescriptorType(SlangBindingType binding_type) {
+    switch (binding_type) {
+        case SLANG_BINDING_TYPE_SAMPLER: {
+            return VK_DESCRIPTOR_TYPE_SAMPLER;
+        }
+        case SLANG_BINDING_TYPE_TEXTURE: {
+            return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        case SLANG_BINDING_TYPE_MUTABLE_TETURE: {
+            return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        }
+        case SLANG_BINDING_TYPE_COMBINED_TEXTURE_SAMPLER: {
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        }
+        case SLANG_BINDING_TYPE_CONSTANT_BUFFER:
+        case SLANG_BINDING_TYPE_PARAMETER_BLOCK: {
+            return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+        case SLANG_BINDING_TYPE_TYPED_BUFFER: {
+            return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        }
+        case SLANG_BINDING_TYPE_MUTABLE_TYPED_BUFFER: {
+            return VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+        }
+        case SLANG_BINDING_TYPE_RAW_BUFFER:
+        case SLANG_BINDING_TYPE_MUTABLE_RAW_BUFFER: {
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        case SLANG_BINDING_TYPE_INPUT_RENDER_TARGET: {
+            return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        }
+        case SLANG_BINDING_TYPE_RAY_TRACING_ACCELERATION_STRUCTURE: {
+            return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        }
+        default: {
+            return std::nullopt;
+        }
+    }
+}
 
-    if (diagnostics) {
-        fprintf(stderr, "%s\n", (const char*)diagnostics->getBufferPointer());
+// The format a vertex shader reads an input as, or undefined for types that can't be vertex inputs.
+static VkFormat GetVertexInputFormat(slang::TypeReflection* type) {
+    uint32_t num_components = 1;
+    slang::TypeReflection* scalar_type = type;
+    if (type->getKind() == slang::TypeReflection::Kind::Vector) {
+        num_components = static_cast<uint32_t>(type->getElementCount());
+        scalar_type = type->getElementType();
+    } else if (type->getKind() != slang::TypeReflection::Kind::Scalar) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    if (num_components < 1 || num_components > 4) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    static constexpr VkFormat FLOAT_FORMATS[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static constexpr VkFormat HALF_FORMATS[] = {VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16B16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT};
+    static constexpr VkFormat INT_FORMATS[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static constexpr VkFormat UINT_FORMATS[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    switch (scalar_type->getScalarType()) {
+        case slang::TypeReflection::ScalarType::Float32: {
+            return FLOAT_FORMATS[num_components - 1];
+        }
+        case slang::TypeReflection::ScalarType::Float16: {
+            return HALF_FORMATS[num_components - 1];
+        }
+        case slang::TypeReflection::ScalarType::Int32: {
+            return INT_FORMATS[num_components - 1];
+        }
+        case slang::TypeReflection::ScalarType::UInt32: {
+            return UINT_FORMATS[num_components - 1];
+        }
+        default: {
+            return VK_FORMAT_UNDEFINED;
+        }
+    }
+}
+
+// Struct inputs are flattened, so every scalar or vector field is an input of its own.
+static void ExtractVertexInputs(slang::VariableLayoutReflection* variable, uint32_t base_location, std::vector<Shader::VertexInput>& vertex_inputs) {
+    uint32_t location = base_location + static_cast<uint32_t>(variable->getOffset(SLANG_PARAMETER_CATEGORY_VARYING_INPUT));
+    slang::TypeLayoutReflection* type_layout = variable->getTypeLayout();
+
+    if (type_layout->getKind() == slang::TypeReflection::Kind::Struct) {
+        for (unsigned field_index = 0; field_index < type_layout->getFieldCount(); field_index++) {
+            ExtractVertexInputs(type_layout->getFieldByIndex(field_index), location, vertex_inputs);
+        }
+        return;
+    }
+
+    // System values don't take up a location, and aren't read from vertex buffers.
+    if (type_layout->getSize(SLANG_PARAMETER_CATEGORY_VARYING_INPUT) == 0) {
+        return;
+    }
+
+    std::string semantic = variable->getName();
+    if (const char* semantic_name = variable->getSemanticName()) {
+        semantic = semantic_name;
+        if (variable->getSemanticIndex() != 0) {
+            semantic += std::to_string(variable->getSemanticIndex());
+        }
+    }
+
+    VkFormat format = GetVertexInputFormat(type_layout->getType());
+    if (format == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("Failed to reflect vertex input " + semantic + ", only scalars and vectors are supported!");
     }
 
+    vertex_inputs.push_back(Shader::VertexInput{location, semantic, format});
+}
+
+Shader::Shader(std::shared_ptr<Device> device, const Binary& binary) :
+    Shader{ device, binary, CreateParameterLayouts(device, binary.parameter_layouts) }
+{}
+
+Shader::Shader(std::shared_ptr<Device> device, const Binary& binary, std::vector<std::shared_ptr<DescriptorSetLayout>> parameter_layouts) :
+    device_{ device },
+    shader_module_{ VK_NULL_HANDLE },
+    shader_object_{ VK_NULL_HANDLE },
+    entry_point_{ binary.entry_point },
+    stage_{ binary.stage },
+    parameter_layouts_{ std::move(parameter_layouts) },
+    vertex_inputs_{ binary.vertex_inputs }
+{
     VkShaderModuleCreateInfo module_info = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = spirv_code->getBufferSize(),
-        .pCode = static_cast<const uint32_t*>(spirv_code->getBufferPointer()),
+        .codeSize = binary.spirv.size() * sizeof(uint32_t),
+        .pCode = binary.spirv.data(),
     };
 
-    vkCreateShaderModule(device_->GetLogicalDevice(), &module_info, nullptr, &shader_module_);
+    if (vkCreateShaderModule(device_->GetLogicalDevice(), &module_info, nullptr, &shader_module_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module!");
+    }
 
-    ExtractParameterLayouts(program);
+    if (device_->UsesShaderObjects()) {
+        CreateShaderObject(binary);
+    }
 }
 
 Shader::~Shader() {
+    if (shader_object_ != VK_NULL_HANDLE) {
+        _vkDestroyShaderEXT(device_->GetLogicalDevice(), shader_object_, nullptr);
+    }
     if (shader_module_ != VK_NULL_HANDLE) {
         vkDestroyShaderModule(device_->GetLogicalDevice(), shader_module_, nullptr);
     }
 }
 
-void Shader::ExtractParameterLayouts(Slang::ComPtr<slang::IComponentType> program) {
-    slang::ProgramLayout* layout = program->getLayout();
-    uint32_t num_types = layout->getTypeParameterCount();
-    std::cout << "Type parameters" << std::endl;
-    for (uint32_t i = 0; i < num_types; i++) {
-        slang::TypeParameterReflection* type = layout->getTypeParameterByIndex(i);
-        std::cout << type->getName() << std::endl;
-    }
-    
-    uint32_t num_parameters = layout->getParameterCount();
-    
-    for (uint32_t parameter_index = 0; parameter_index < num_parameters; parameter_index++) {
-        slang::VariableLayoutReflection* variable = layout->getParameterByIndex(parameter_index);
-        slang::ParameterCategory var_category = variable->getCategory();
-        unsigned index = variable->getBindingIndex();
-        unsigned space = variable->getBindingSpace() + variable->getOffset(static_cast<SlangParameterCategory>(var_category));
-        slang::TypeReflection::Kind kind = variable->getType()->getKind();
-        std::cout << "set " << space << ", binding " << index
-            << ": " << variable->getType()->getName() << " " << variable->getName() << std::endl;
-
-        unsigned categoryCount = variable->getCategoryCount();
-        std::cout << "Category count: " << categoryCount << std::endl;
-        for (unsigned cc = 0; cc < categoryCount; cc++)
-        {
-            slang::ParameterCategory category = variable->getCategoryByIndex(cc);
-
-            size_t offsetForCategory = variable->getOffset(static_cast<SlangParameterCategory>(category));
-            size_t spaceForCategory = variable->getBindingSpace(static_cast<SlangParameterCategory>(category))
-                + variable->getOffset(SLANG_PARAMETER_CATEGORY_REGISTER_SPACE);
-
-            std::cout << "Offset: " << offsetForCategory << ", space: " << spaceForCategory << std::endl;
-        }
-
-        slang::TypeLayoutReflection* typeLayout = variable->getTypeLayout();
-        slang::TypeLayoutReflection* elementLayout = typeLayout->getElementTypeLayout();
-        uint32_t fields = elementLayout->getFieldCount();
-        for (unsigned ff = 0; ff < fields; ff++)
-        {
-            slang::VariableLayoutReflection* field = elementLayout->getFieldByIndex(ff);
-            std::cout << field->getType()->getName() << " " << field->getName() << std::endl;
-        }
-    }
-    
-    SlangUInt entryPointCount = layout->getEntryPointCount();
-    for (SlangUInt ee = 0; ee < entryPointCount; ee++)
-    {
-        slang::EntryPointReflection* entry =
-            layout->getEntryPointByIndex(ee);
-        
-        std::cout << "Entry point: " << entry->getName() << ", Name Override: " << entry->getNameOverride() << std::endl;
-        SlangStage stage = entry->getStage();
-
-        SlangUInt threadGroupSize[3];
-        entry->getComputeThreadGroupSize(3, &threadGroupSize[0]);
-        std::cout << "Thread group size: " << threadGroupSize[0] << " " << threadGroupSize[1] << " " << threadGroupSize[2] << std::endl;
-
-        unsigned parameterCount = entry->getParameterCount();
-        for (unsigned pp = 0; pp < parameterCount; pp++)
-        {
-            slang::VariableLayoutReflection* parameter =
-                entry->getParameterByIndex(pp);
-
-            std::cout << "entry " << parameter->getType()->getName() << " " << parameter->getName() << std::endl;
-            slang::TypeLayoutReflection* type = parameter->getTypeLayout();
-            unsigned fieldCount = type->getFieldCount();
-            for (unsigned ff = 0; ff < fieldCount; ff++)
-            {
-                slang::VariableLayoutReflection* field = type->getFieldByIndex(ff);
-                std::cout << "Field: " << field->getType()->getName()  << " " << field->getName() << std::endl;
+void Shader::CreateShaderObject(const Binary& binary) {
+    // Created with the shader's own set layouts. Binding descriptor sets for it needs a pipeline layout compatible with
+    // them, so shaders that are bound together can't use different sets, see DynamicStateTracker::BindGraphics().
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    for (const std::shared_ptr<DescriptorSetLayout>& parameter_layout : parameter_layouts_) {
+        set_layouts.push_back(parameter_layout->GetLayout());
+    }
+
+    // Shaders aren't linked, so any vertex shader can be bound with any fragment shader.
+    VkShaderCreateInfoEXT shader_info = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
+        .flags = 0,
+        .stage = stage_,
+        .nextStage = (stage_ == VK_SHADER_STAGE_VERTEX_BIT) ? static_cast<VkShaderStageFlags>(VK_SHADER_STAGE_FRAGMENT_BIT) : 0,
+        .codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT,
+        .codeSize = binary.spirv.size() * sizeof(uint32_t),
+        .pCode = binary.spirv.data(),
+        .pName = "main",
+        .setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+        .pSetLayouts = set_layouts.data(),
+    };
+
+    if (_vkCreateShadersEXT(device_->GetLogicalDevice(), 1, &shader_info, nullptr, &shader_object_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader object!");
+    }
+}
+
+std::vector<std::shared_ptr<DescriptorSetLayout>> Shader::CreateParameterLayouts(std::shared_ptr<Device> device, const std::vector<std::vector<DescriptorSetLayout::BindingInfo>>& parameter_layouts) {
+    std::vector<std::shared_ptr<DescriptorSetLayout>> set_layouts;
+    for (const std::vector<DescriptorSetLayout::BindingInfo>& bindings : parameter_layouts) {
+        set_layouts.push_back(device->GetLayoutCache().GetDescriptorSetLayout(bindings));
+    }
+    return set_layouts;
+}
+
+void ShaderCompiler::ExtractParameterLayouts(Slang::ComPtr<slang::IComponentType> program, std::vector<std::vector<DescriptorSetLayout::BindingInfo>>& parameter_layouts) {
+    slang::ProgramLayout* program_layout = program->getLayout();
+
+    // Reflection doesn't tell which entry points actually use a parameter, so every binding
+    // is visible to all stages of the program.
+    VkShaderStageFlags stage_flags = 0;
+    for (SlangUInt entry_point_index = 0; entry_point_index < program_layout->getEntryPointCount(); entry_point_index++) {
+        stage_flags |= GetShaderStage(program_layout->getEntryPointByIndex(entry_point_index)->getStage());
+    }
+
+    auto add_binding = [&](uint32_t set, uint32_t binding, VkDescriptorType descriptor_type, uint32_t descriptor_count) {
+        if (set >= parameter_layouts.size()) {
+            parameter_layouts.resize(set + 1);
+        }
+
+        parameter_layouts[set].push_back(DescriptorSetLayout::BindingInfo{
+            .binding = binding,
+            .descriptor_type = descriptor_type,
+            .descriptor_count = descriptor_count,
+            .stage_flags = stage_flags,
+        });
+
+        LOG(LogShaderCompiler, Logger::SeverityLevel::TRACE, "Set {0}, binding {1}: {2} descriptor(s) of type {3}", set, binding, descriptor_count, static_cast<uint32_t>(descriptor_type));
+    };
+
+    // Global parameters that are plain data end up in a uniform buffer Slang adds for them.
+    slang::VariableLayoutReflection* global_parameters = program_layout->getGlobalParamsVarLayout();
+    if (global_parameters->getTypeLayout()->getKind() == slang::TypeReflection::Kind::ConstantBuffer) {
+        add_binding(static_cast<uint32_t>(global_parameters->getBindingSpace(SLANG_PARAMETER_CATEGORY_DESCRIPTOR_TABLE_SLOT)),
+                    static_cast<uint32_t>(global_parameters->getOffset(SLANG_PARAMETER_CATEGORY_DESCRIPTOR_TABLE_SLOT)),
+                    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+    }
+
+    // Uniform entry point parameters would need push constants, which aren't supported yet.
+    for (uint32_t parameter_index = 0; parameter_index < program_layout->getParameterCount(); parameter_index++) {
+        slang::VariableLayoutReflection* variable = program_layout->getParameterByIndex(parameter_index);
+        slang::TypeLayoutReflection* type_layout = variable->getTypeLayout();
+
+        if (type_layout->getKind() == slang::TypeReflection::Kind::ParameterBlock) {
+            // Every parameter block gets a set of its own, starting with a uniform buffer for its plain data if it has any.
+            // The rest of its bindings are numbered in order after that.
+            uint32_t set = static_cast<uint32_t>(variable->getOffset(SLANG_PARAMETER_CATEGORY_SUB_ELEMENT_REGISTER_SPACE));
+            slang::TypeLayoutReflection* element_layout = type_layout->getElementTypeLayout();
+
+            uint32_t binding = 0;
+            if (element_layout->getSize() > 0) {
+                add_binding(set, binding++, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+            }
+
+            if (element_layout->getDescriptorSetCount() > 0) {
+                for (SlangInt range_index = 0; range_index < element_layout->getDescriptorSetDescriptorRangeCount(0); range_index++) {
+                    std::optional<VkDescriptorType> descriptor_type = GetDescriptorType(static_cast<SlangBindingType>(element_layout->getDescriptorSetDescriptorRangeType(0, range_index)));
+                    if (descriptor_type.has_value()) {
+                        add_binding(set, binding++, descriptor_type.value(), static_cast<uint32_t>(element_layout->getDescriptorSetDescriptorRangeDescriptorCount(0, range_index)));
+                    }
+                }
+            }
+        } else if (type_layout->getDescriptorSetCount() > 0) {
+            // Anything else declared at global scope is bound where Slang placed it, usually in set 0.
+            uint32_t set = static_cast<uint32_t>(variable->getBindingSpace(SLANG_PARAMETER_CATEGORY_DESCRIPTOR_TABLE_SLOT));
+            uint32_t first_binding = static_cast<uint32_t>(variable->getOffset(SLANG_PARAMETER_CATEGORY_DESCRIPTOR_TABLE_SLOT));
+
+            for (SlangInt range_index = 0; range_index < type_layout->getDescriptorSetDescriptorRangeCount(0); range_index++) {
+                std::optional<VkDescriptorType> descriptor_type = GetDescriptorType(static_cast<SlangBindingType>(type_layout->getDescriptorSetDescriptorRangeType(0, range_index)));
+                if (descriptor_type.has_value()) {
+                    add_binding(set, first_binding + static_cast<uint32_t>(type_layout->getDescriptorSetDescriptorRangeIndexOffset(0, range_index)),
+                                descriptor_type.value(), static_cast<uint32_t>(type_layout->getDescriptorSetDescriptorRangeDescriptorCount(0, range_index)));
+                }
             }
         }
     }
 
-    // TODO: this is just a dummy implementation for the HelloWorldCompute example
-    DescriptorSetLayout::BindingInfo binding_info = {
-        .descriptor_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .stage_flags = VK_SHADER_STAGE_COMPUTE_BIT,
-    };
+    // The arrays of the bindless heap are unsized in Bindless.slang, and a shader may only declare some of them.
+    // Whatever it uses, the set gets the heap's layout, so that the heap's descriptor set can be bound to it.
+    // That only works if everything in the set is actually part of the heap.
+    if (BindlessHeap::SET < parameter_layouts.size() && !parameter_layouts[BindlessHeap::SET].empty()) {
+        std::vector<DescriptorSetLayout::BindingInfo> heap_bindings = BindlessHeap::GetBindings();
+        for (const DescriptorSetLayout::BindingInfo& binding : parameter_layouts[BindlessHeap::SET]) {
+            auto heap_binding = std::find_if(heap_bindings.begin(), heap_bindings.end(), [&](const DescriptorSetLayout::BindingInfo& candidate) {
+                return candidate.binding == binding.binding;
+            });
 
-    std::shared_ptr<DescriptorSetLayout> set_layout = std::make_shared<DescriptorSetLayout>(device_);
-    set_layout->AddBinding(binding_info);
-    set_layout->AddBinding(binding_info);
-    set_layout->AddBinding(binding_info); // 3 buffers used here
-    set_layout->Compile();
-    parameter_layouts_.push_back(set_layout);
+            // Unsized arrays are reflected with an unbounded count, anything sized has to fit into the heap.
+            bool is_heap_binding = heap_binding != heap_bindings.end() && heap_binding->descriptor_type == binding.descriptor_type &&
+                                   (binding.descriptor_count == UINT32_MAX || binding.descriptor_count <= heap_binding->descriptor_count);
+            if (!is_heap_binding) {
+                throw std::runtime_error("Failed to extract parameter layouts, binding " + std::to_string(binding.binding) + " of set " +
+                                         std::to_string(BindlessHeap::SET) + " isn't part of the bindless heap!");
+            }
+        }
+
+        parameter_layouts[BindlessHeap::SET] = heap_bindings;
+    }
 }
 
-ShaderCompiler::ShaderCompiler(std::shared_ptr<Device> device) :
-    device_{ device }
+ShaderCompiler::ShaderCompiler(std::shared_ptr<Device> device, bool use_disk_cache, uint32_t num_worker_threads) :
+    device_{ device },
+    target_profile_{ "glsl_450" },
+    num_worker_threads_{ num_worker_threads }
 {
     search_paths_.push_back(SHADER_DIRECTORY);
-    CreateSession();
+
+    // Slang sessions are only created once something actually has to be compiled.
+    if (use_disk_cache) {
+        disk_cache_ = std::make_unique<ShaderCache>(SHADER_CACHE_DIRECTORY);
+    }
 }
 
+ShaderCompiler::~ShaderCompiler() = default;
+
 std::shared_ptr<Shader> ShaderCompiler::LoadShader(const std::string& shader_file, const std::string& entry_point_name) {
+    return LoadProgram(main_session_, shader_file, {entry_point_name}).front();
+}
+
+std::vector<std::shared_ptr<Shader>> ShaderCompiler::LoadProgram(const std::string& shader_file, const std::vector<std::string>& entry_point_names) {
+    return LoadProgram(main_session_, shader_file, entry_point_names);
+}
+
+std::future<std::shared_ptr<Shader>> ShaderCompiler::LoadShaderAsync(const std::string& shader_file, const std::string& entry_point_name) {
+    {
+        std::lock_guard<std::mutex> lock{ thread_pool_mutex_ };
+        if (thread_pool_ == nullptr) {
+            thread_pool_ = std::make_unique<ThreadPool>(num_worker_threads_);
+            worker_sessions_.resize(thread_pool_->GetNumThreads());
+        }
+    }
+
+    // Each worker only ever touches its own session, so they don't need any locking.
+    return thread_pool_->Submit([this, shader_file, entry_point_name](uint32_t thread_index) {
+        return LoadProgram(worker_sessions_[thread_index], shader_file, {entry_point_name}).front();
+    });
+}
+
+std::vector<std::shared_ptr<Shader>> ShaderCompiler::LoadProgram(SlangSession& session, const std::string& shader_file, const std::vector<std::string>& entry_point_names) {
+    assert(!entry_point_names.empty());
+
+    // The order entry points are requested in doesn't change what they compile to.
+    std::vector<std::string> program_entry_points = entry_point_names;
+    std::sort(program_entry_points.begin(), program_entry_points.end());
+
+    std::vector<ShaderCache::Key> cache_keys;
+    for (const std::string& entry_point_name : entry_point_names) {
+        ShaderCache::Key& cache_key = cache_keys.emplace_back(ShaderCache::Key{
+            .module_name = shader_file,
+            .entry_point = entry_point_name,
+            .program_entry_points = program_entry_points,
+            .target_profile = target_profile_,
+            .compiler_version = spGetBuildTagString(),
+        });
+
+        for (const char* search_path : search_paths_) {
+            cache_key.search_paths.emplace_back(search_path);
+        }
+
+        for (const auto& macro : shader_macros_) {
+            cache_key.macros.emplace_back(macro.first, macro.second);
+        }
+    }
+
+    // The program is only compiled if any of its entry points is missing from the cache,
+    // in which case all of them are compiled together anyway.
+    std::vector<Shader::Binary> binaries;
+    if (disk_cache_ != nullptr) {
+        for (const ShaderCache::Key& cache_key : cache_keys) {
+            std::optional<Shader::Binary> cached_binary = disk_cache_->Load(cache_key);
+            if (!cached_binary.has_value()) {
+                binaries.clear();
+                break;
+            }
+            binaries.push_back(std::move(cached_binary.value()));
+        }
+    }
+
+    if (!binaries.empty()) {
+        LOG(LogShaderCompiler, Logger::SeverityLevel::TRACE, "Loaded {0} entry points of {1} from the shader cache", binaries.size(), shader_file);
+    } else {
+        std::vector<std::string> dependencies;
+        binaries = CompileProgram(session, shader_file, entry_point_names, dependencies);
+
+        if (disk_cache_ != nullptr) {
+            for (size_t entry_point_index = 0; entry_point_index < binaries.size(); entry_point_index++) {
+                disk_cache_->Store(cache_keys[entry_point_index], dependencies, binaries[entry_point_index]);
+            }
+        }
+    }
+
+    // Entry points of the same program see the same parameters, so they end up with the same layouts from the cache.
+    std::vector<std::shared_ptr<Shader>> shaders;
+    for (const Shader::Binary& binary : binaries) {
+        shaders.push_back(std::make_shared<Shader>(device_, binary));
+    }
+
+    return shaders;
+}
+
+std::vector<Shader::Binary> ShaderCompiler::CompileProgram(SlangSession& session, const std::string& shader_file, const std::vector<std::string>& entry_point_names, std::vector<std::string>& dependencies) {
+    if (session.global_session == nullptr) {
+        CreateSession(session);
+    }
+
     Slang::ComPtr<slang::IBlob> diagnostics;
-    slang::IModule* module = local_session_->loadModule(shader_file.c_str(), diagnostics.writeRef());
+    slang::IModule* module = session.local_session->loadModule(shader_file.c_str(), diagnostics.writeRef());
 
     if (diagnostics) {
         fprintf(stderr, "%s\n", (const char*)diagnostics->getBufferPointer());
     }
 
-    Slang::ComPtr<slang::IEntryPoint> entry_point;
-    module->findEntryPointByName(entry_point_name.c_str(), entry_point.writeRef());
+    if (module == nullptr) {
+        throw std::runtime_error("Failed to load shader module " + shader_file + "!");
+    }
+
+    // The entry points are linked together with the module into a single program, so the front-end
+    // work and the reflection are shared, and entry point i of the program is the i-th requested one.
+    std::vector<Slang::ComPtr<slang::IEntryPoint>> entry_points(entry_point_names.size());
+    std::vector<slang::IComponentType*> components = { module };
+    for (size_t entry_point_index = 0; entry_point_index < entry_point_names.size(); entry_point_index++) {
+        const std::string& entry_point_name = entry_point_names[entry_point_index];
+        module->findEntryPointByName(entry_point_name.c_str(), entry_points[entry_point_index].writeRef());
+
+        if (entry_points[entry_point_index] == nullptr) {
+            throw std::runtime_error("Failed to find entry point " + entry_point_name + " in " + shader_file + "!");
+        }
+        components.push_back(entry_points[entry_point_index]);
+    }
 
-    slang::IComponentType* components[] = { module, entry_point };
     Slang::ComPtr<slang::IComponentType> program;
-    local_session_->createCompositeComponentType(components, 2, program.writeRef(), diagnostics.writeRef());
+    session.local_session->createCompositeComponentType(components.data(), components.size(), program.writeRef(), diagnostics.writeRef());
 
     if (diagnostics) {
         fprintf(stderr, "%s\n", (const char*)diagnostics->getBufferPointer());
     }
 
-    return std::make_shared<Shader>(device_, program);
+    if (program == nullptr) {
+        throw std::runtime_error("Failed to link shader program " + shader_file + "!");
+    }
+
+    std::vector<std::vector<DescriptorSetLayout::BindingInfo>> parameter_layouts;
+    ExtractParameterLayouts(program, parameter_layouts);
+
+    slang::ProgramLayout* program_layout = program->getLayout();
+    std::vector<Shader::Binary> binaries;
+    for (size_t entry_point_index = 0; entry_point_index < entry_point_names.size(); entry_point_index++) {
+        Slang::ComPtr<slang::IBlob> spirv_code;
+        program->getEntryPointCode(entry_point_index, 0, spirv_code.writeRef(), diagnostics.writeRef());
+
+        if (diagnostics) {
+            fprintf(stderr, "%s\n", (const char*)diagnostics->getBufferPointer());
+        }
+
+        if (spirv_code == nullptr) {
+            throw std::runtime_error("Failed to generate SPIR-V for " + shader_file + ":" + entry_point_names[entry_point_index] + "!");
+        }
+
+        slang::EntryPointReflection* entry_point_reflection = program_layout->getEntryPointByIndex(entry_point_index);
+
+        Shader::Binary& binary = binaries.emplace_back(Shader::Binary{
+            .entry_point = entry_point_reflection->getName(),
+            .stage = GetShaderStage(entry_point_reflection->getStage()),
+            .parameter_layouts = parameter_layouts,
+        });
+
+        const uint32_t* spirv_words = static_cast<const uint32_t*>(spirv_code->getBufferPointer());
+        binary.spirv.assign(spirv_words, spirv_words + spirv_code->getBufferSize() / sizeof(uint32_t));
+
+        if (binary.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+            for (unsigned parameter_index = 0; parameter_index < entry_point_reflection->getParameterCount(); parameter_index++) {
+                ExtractVertexInputs(entry_point_reflection->getParameterByIndex(parameter_index), 0, binary.vertex_inputs);
+            }
+
+            std::sort(binary.vertex_inputs.begin(), binary.vertex_inputs.end(), [](const Shader::VertexInput& first, const Shader::VertexInput& second) {
+                return first.location < second.location;
+            });
+        }
+    }
+
+    // Every file the module was loaded from, including everything it imports.
+    for (int32_t dependency_index = 0; dependency_index < module->getDependencyFileCount(); dependency_index++) {
+        dependencies.emplace_back(module->getDependencyFilePath(dependency_index));
+    }
+
+    return binaries;
 }
 
-void ShaderCompiler::CreateSession() {
-    slang::createGlobalSession(global_session_.writeRef());
+void ShaderCompiler::CreateSession(SlangSession& session) {
+    slang::createGlobalSession(session.global_session.writeRef());
 
     slang::TargetDesc target_info = {
         .format = SLANG_SPIRV,
-        .profile = global_session_->findProfile("glsl_450"),
+        .profile = session.global_session->findProfile(target_profile_.c_str()),
         .flags = SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY,
     };
 
@@ -183,5 +524,5 @@ void ShaderCompiler::CreateSession() {
         .preprocessorMacroCount = static_cast<uint32_t>(macros.size()),
     };
 
-    global_session_->createSession(session_info, local_session_.writeRef());
+    session.global_session->createSession(session_info, session.local_session.writeRef());
 }
\ No newline at end of file
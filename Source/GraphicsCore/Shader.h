@@ -1,7 +1,10 @@
 #pragma once
 
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -9,43 +12,105 @@
 #include <slang-com-ptr.h>
 #include <vulkan/vulkan.h>
 
+#include "../CoreUtility/ThreadPool.h"
 #include "Parameters.h"
 
+class ShaderCache;
+
 class Shader {
 public:
-    Shader(std::shared_ptr<Device> device, Slang::ComPtr<slang::IComponentType> program);
+    // An input of a vertex shader, as the shader declares it.
+    struct VertexInput {
+        uint32_t location;
+        // The semantic, with its index appended unless it is 0 (e.g. "TEXCOORD1"), or the name of the input if it has none.
+        std::string semantic;
+        // What the shader reads, e.g. R32G32B32_SFLOAT for a float3. Vertex buffers can hold other formats that convert to it.
+        VkFormat format;
+    };
+
+    // Everything needed to create a shader without going through Slang, which is also what the disk cache stores.
+    struct Binary {
+        std::string entry_point;
+        VkShaderStageFlagBits stage;
+        std::vector<uint32_t> spirv;
+        // The bindings of every descriptor set, in set order.
+        std::vector<std::vector<DescriptorSetLayout::BindingInfo>> parameter_layouts;
+        // Only for vertex shaders, in location order. System values like SV_VertexID aren't included.
+        std::vector<VertexInput> vertex_inputs;
+    };
+
+    Shader(std::shared_ptr<Device> device, const Binary& binary);
+    // For layouts that were already created, e.g. from the device's layout cache.
+    Shader(std::shared_ptr<Device> device, const Binary& binary, std::vector<std::shared_ptr<DescriptorSetLayout>> parameter_layouts);
     ~Shader();
 
     inline VkShaderModule GetModule() const {return shader_module_;}
+    // Only created if the device uses shader objects, otherwise null. See DynamicStateTracker for binding it.
+    inline VkShaderEXT GetShaderObject() const {return shader_object_;}
     inline const std::vector<std::shared_ptr<DescriptorSetLayout>>& GetParameterLayouts() const {return parameter_layouts_;}
-    inline const char* GetEntryPointName() const {return entry_point_;}
+    inline const char* GetEntryPointName() const {return entry_point_.c_str();}
+    inline VkShaderStageFlagBits GetStage() const {return stage_;}
+    inline const std::vector<VertexInput>& GetVertexInputs() const {return vertex_inputs_;}
+
+    static std::vector<std::shared_ptr<DescriptorSetLayout>> CreateParameterLayouts(std::shared_ptr<Device> device, const std::vector<std::vector<DescriptorSetLayout::BindingInfo>>& parameter_layouts);
 
 private:
     std::shared_ptr<Device> device_;
 
     VkShaderModule shader_module_;
-    const char* entry_point_;
+    VkShaderEXT shader_object_;
+    std::string entry_point_;
+    VkShaderStageFlagBits stage_;
     std::vector<std::shared_ptr<DescriptorSetLayout>> parameter_layouts_;
+    std::vector<VertexInput> vertex_inputs_;
 
-    void ExtractParameterLayouts(Slang::ComPtr<slang::IComponentType> program);
+    void CreateShaderObject(const Binary& binary);
 };
 
 class ShaderCompiler {
 public:
-    ShaderCompiler(std::shared_ptr<Device> device);
-    ~ShaderCompiler() = default;
+    // With the disk cache, shaders that were compiled before from the same sources and settings
+    // are loaded straight from the cache, without starting up Slang at all.
+    // Asynchronous loads run on a pool of worker threads, which is only started on first use.
+    ShaderCompiler(std::shared_ptr<Device> device, bool use_disk_cache = true, uint32_t num_worker_threads = std::thread::hardware_concurrency());
+    ~ShaderCompiler();
     
     std::shared_ptr<Shader> LoadShader(const std::string& shader_file, const std::string& entry_point_name);
 
+    // Loads several entry points of the same module, returned in the same order. The module is only loaded and
+    // linked once for all of them, and the resulting shaders share the layouts of their parameters.
+    std::vector<std::shared_ptr<Shader>> LoadProgram(const std::string& shader_file, const std::vector<std::string>& entry_point_names);
+
+    // Compilation errors are rethrown when getting the shader from the future.
+    std::future<std::shared_ptr<Shader>> LoadShaderAsync(const std::string& shader_file, const std::string& entry_point_name);
+
 private:
-    std::shared_ptr<Device> device_;
-    Slang::ComPtr<slang::IGlobalSession> global_session_;
+    // Slang objects can only be used by one thread at a time, including the global session,
+    // so every thread that compiles shaders has its own.
+    struct SlangSession {
+        Slang::ComPtr<slang::IGlobalSession> global_session;
+        Slang::ComPtr<slang::ISession> local_session;
+    };
 
-    // All shaders will share the same session
-    Slang::ComPtr<slang::ISession> local_session_; 
+    std::shared_ptr<Device> device_;
 
     std::vector<const char*> search_paths_; 
     std::vector<std::pair<const char*, const char*>> shader_macros_;
+    std::string target_profile_;
+
+    std::unique_ptr<ShaderCache> disk_cache_;
+
+    // The main session is used by LoadShader() on the caller's thread, the others by the workers.
+    SlangSession main_session_;
+    std::vector<SlangSession> worker_sessions_;
+
+    // Declared last, so the workers are done before anything they use is destroyed.
+    uint32_t num_worker_threads_;
+    std::mutex thread_pool_mutex_;
+    std::unique_ptr<ThreadPool> thread_pool_;
 
-    void CreateSession();
+    void CreateSession(SlangSession& session);
+    std::vector<std::shared_ptr<Shader>> LoadProgram(SlangSession& session, const std::string& shader_file, const std::vector<std::string>& entry_point_names);
+    std::vector<Shader::Binary> CompileProgram(SlangSession& session, const std::string& shader_file, const std::vector<std::string>& entry_point_names, std::vector<std::string>& dependencies);
+    void ExtractParameterLayouts(Slang::ComPtr<slang::IComponentType> program, std::vector<std::vector<DescriptorSetLayout::BindingInfo>>& parameter_layouts);
 };
\ No newline at end of file
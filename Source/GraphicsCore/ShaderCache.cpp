@@ -0,0 +1,270 @@
+#include "ShaderCache.h"
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#include "../CoreUtility/Hash.h"
+#include "Utility.h"
+
+DEFINE_LOGGER(LogShaderCache, Logger::SeverityLevel::INFO);
+
+// The version has to be bumped whenever the layout of an entry changes, so old entries are ignored.
+static constexpr uint32_t CACHE_MAGIC = 0x43444853; // "SHDC"
+static constexpr uint32_t CACHE_VERSION = 4;
+
+// Anything bigger than this in an entry means the file is corrupt.
+static constexpr uint32_t MAX_ENTRY_ELEMENTS = 64 * 1024 * 1024;
+
+template<typename T> static void WriteValue(std::ostream& stream, const T& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void WriteString(std::ostream& stream, const std::string& value) {
+    WriteValue(stream, static_cast<uint32_t>(value.size()));
+    stream.write(value.data(), value.size());
+}
+
+template<typename T> static bool ReadValue(std::istream& stream, T& value) {
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return stream.good();
+}
+
+static bool ReadSize(std::istream& stream, uint32_t& size) {
+    return ReadValue(stream, size) && size <= MAX_ENTRY_ELEMENTS;
+}
+
+static bool ReadString(std::istream& stream, std::string& value) {
+    uint32_t size;
+    if (!ReadSize(stream, size)) {
+        return false;
+    }
+
+    value.resize(size);
+    stream.read(value.data(), size);
+    return stream.good();
+}
+
+static std::string SerializeKey(const ShaderCache::Key& key) {
+    // Every field is prefixed with its length, so that no two different keys end up as the same string.
+    std::string serialized_key;
+    auto append = [&](const std::string& value) {
+        serialized_key += std::to_string(value.size()) + ":" + value + ";";
+    };
+
+    append(key.module_name);
+    append(key.entry_point);
+
+    append(std::to_string(key.program_entry_points.size()));
+    for (const std::string& entry_point : key.program_entry_points) {
+        append(entry_point);
+    }
+
+    append(key.target_profile);
+    append(key.compiler_version);
+
+    append(std::to_string(key.search_paths.size()));
+    for (const std::string& search_path : key.search_paths) {
+        append(search_path);
+    }
+
+    append(std::to_string(key.macros.size()));
+    for (const auto& [name, value] : key.macros) {
+        append(name);
+        append(value);
+    }
+
+    return serialized_key;
+}
+
+static std::string ToHexString(uint64_t value) {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+}
+
+static std::optional<uint64_t> HashFile(const std::filesystem::path& path) {
+    std::ifstream file{ path, std::ios::binary };
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::vector<char> contents{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    return HashBytes(contents.data(), contents.size());
+}
+
+ShaderCache::ShaderCache(const std::filesystem::path& cache_directory) :
+    cache_directory_{ cache_directory }
+{}
+
+std::optional<Shader::Binary> ShaderCache::Load(const Key& key) const {
+    std::string serialized_key = SerializeKey(key);
+    std::ifstream file{ GetEntryPath(serialized_key), std::ios::binary };
+    if (!file) {
+        return std::nullopt;
+    }
+
+    uint32_t magic, version;
+    if (!ReadValue(file, magic) || !ReadValue(file, version) || magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return std::nullopt;
+    }
+
+    // The file name is only a hash of the key, so the full key is compared in case of a collision.
+    std::string stored_key;
+    if (!ReadString(file, stored_key) || stored_key != serialized_key) {
+        return std::nullopt;
+    }
+
+    uint32_t num_dependencies;
+    if (!ReadSize(file, num_dependencies)) {
+        return std::nullopt;
+    }
+
+    for (uint32_t dependency_index = 0; dependency_index < num_dependencies; dependency_index++) {
+        std::string dependency;
+        uint64_t stored_hash;
+        if (!ReadString(file, dependency) || !ReadValue(file, stored_hash)) {
+            return std::nullopt;
+        }
+
+        std::optional<uint64_t> current_hash = HashFile(dependency);
+        if (!current_hash.has_value() || current_hash.value() != stored_hash) {
+            LOG(LogShaderCache, Logger::SeverityLevel::TRACE, "Shader cache entry for {0}:{1} is stale, {2} changed", key.module_name, key.entry_point, dependency);
+            return std::nullopt;
+        }
+    }
+
+    Shader::Binary binary;
+    uint32_t stage, num_words, num_sets;
+    if (!ReadString(file, binary.entry_point) || !ReadValue(file, stage) || !ReadSize(file, num_words)) {
+        return std::nullopt;
+    }
+    binary.stage = static_cast<VkShaderStageFlagBits>(stage);
+
+    binary.spirv.resize(num_words);
+    file.read(reinterpret_cast<char*>(binary.spirv.data()), num_words * sizeof(uint32_t));
+    if (!file.good() || !ReadSize(file, num_sets)) {
+        return std::nullopt;
+    }
+
+    binary.parameter_layouts.resize(num_sets);
+    for (std::vector<DescriptorSetLayout::BindingInfo>& bindings : binary.parameter_layouts) {
+        uint32_t num_bindings;
+        if (!ReadSize(file, num_bindings)) {
+            return std::nullopt;
+        }
+
+        bindings.resize(num_bindings);
+        for (DescriptorSetLayout::BindingInfo& binding : bindings) {
+            uint32_t descriptor_type, stage_flags, binding_flags;
+            if (!ReadValue(file, binding.binding) || !ReadValue(file, descriptor_type) || !ReadValue(file, binding.descriptor_count) ||
+                !ReadValue(file, stage_flags) || !ReadValue(file, binding_flags)) {
+                return std::nullopt;
+            }
+            binding.descriptor_type = static_cast<VkDescriptorType>(descriptor_type);
+            binding.stage_flags = static_cast<VkShaderStageFlags>(stage_flags);
+            binding.binding_flags = static_cast<VkDescriptorBindingFlags>(binding_flags);
+        }
+    }
+
+    uint32_t num_vertex_inputs;
+    if (!ReadSize(file, num_vertex_inputs)) {
+        return std::nullopt;
+    }
+
+    binary.vertex_inputs.resize(num_vertex_inputs);
+    for (Shader::VertexInput& vertex_input : binary.vertex_inputs) {
+        uint32_t format;
+        if (!ReadValue(file, vertex_input.location) || !ReadString(file, vertex_input.semantic) || !ReadValue(file, format)) {
+            return std::nullopt;
+        }
+        vertex_input.format = static_cast<VkFormat>(format);
+    }
+
+    return binary;
+}
+
+void ShaderCache::Store(const Key& key, const std::vector<std::string>& dependencies, const Shader::Binary& binary) const {
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory_, error);
+    if (error) {
+        LOG(LogShaderCache, Logger::SeverityLevel::WARN, "Failed to create shader cache directory {0}: {1}", cache_directory_.string(), error.message());
+        return;
+    }
+
+    std::vector<uint64_t> dependency_hashes;
+    for (const std::string& dependency : dependencies) {
+        std::optional<uint64_t> hash = HashFile(dependency);
+        if (!hash.has_value()) {
+            // Without being able to tell whether the file changed, the entry could never be trusted.
+            LOG(LogShaderCache, Logger::SeverityLevel::WARN, "Not caching {0}:{1}, failed to read {2}", key.module_name, key.entry_point, dependency);
+            return;
+        }
+        dependency_hashes.push_back(hash.value());
+    }
+
+    std::string serialized_key = SerializeKey(key);
+    std::filesystem::path entry_path = GetEntryPath(serialized_key);
+
+    // Entries are written to a temporary file first and then renamed, so that other processes
+    // (or threads) loading the same shader never see a partially written entry.
+    std::filesystem::path temporary_path = entry_path;
+    temporary_path += "." + ToHexString(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    {
+        std::ofstream file{ temporary_path, std::ios::binary | std::ios::trunc };
+        WriteValue(file, CACHE_MAGIC);
+        WriteValue(file, CACHE_VERSION);
+        WriteString(file, serialized_key);
+
+        WriteValue(file, static_cast<uint32_t>(dependencies.size()));
+        for (size_t dependency_index = 0; dependency_index < dependencies.size(); dependency_index++) {
+            WriteString(file, dependencies[dependency_index]);
+            WriteValue(file, dependency_hashes[dependency_index]);
+        }
+
+        WriteString(file, binary.entry_point);
+        WriteValue(file, static_cast<uint32_t>(binary.stage));
+        WriteValue(file, static_cast<uint32_t>(binary.spirv.size()));
+        file.write(reinterpret_cast<const char*>(binary.spirv.data()), binary.spirv.size() * sizeof(uint32_t));
+
+        WriteValue(file, static_cast<uint32_t>(binary.parameter_layouts.size()));
+        for (const std::vector<DescriptorSetLayout::BindingInfo>& bindings : binary.parameter_layouts) {
+            WriteValue(file, static_cast<uint32_t>(bindings.size()));
+            for (const DescriptorSetLayout::BindingInfo& binding : bindings) {
+                WriteValue(file, binding.binding);
+                WriteValue(file, static_cast<uint32_t>(binding.descriptor_type));
+                WriteValue(file, binding.descriptor_count);
+                WriteValue(file, static_cast<uint32_t>(binding.stage_flags));
+                WriteValue(file, static_cast<uint32_t>(binding.binding_flags));
+            }
+        }
+
+        WriteValue(file, static_cast<uint32_t>(binary.vertex_inputs.size()));
+        for (const Shader::VertexInput& vertex_input : binary.vertex_inputs) {
+            WriteValue(file, vertex_input.location);
+            WriteString(file, vertex_input.semantic);
+            WriteValue(file, static_cast<uint32_t>(vertex_input.format));
+        }
+
+        if (!file.good()) {
+            error = std::make_error_code(std::errc::io_error);
+        }
+    }
+
+    if (!error) {
+        std::filesystem::rename(temporary_path, entry_path, error);
+    }
+
+    if (error) {
+        LOG(LogShaderCache, Logger::SeverityLevel::WARN, "Failed to write shader cache entry {0}: {1}", entry_path.string(), error.message());
+        std::filesystem::remove(temporary_path, error);
+    }
+}
+
+std::filesystem::path ShaderCache::GetEntryPath(const std::string& serialized_key) const {
+    return cache_directory_ / (ToHexString(HashString(serialized_key)) + ".spvcache");
+}
\ No newline at end of file
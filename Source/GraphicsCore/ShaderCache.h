@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Shader.h"
+
+// Compiled shaders on disk, so that loading a shader that was compiled before doesn't have to go through Slang.
+// Entries are addressed by a hash of everything that affects compilation other than the source files themselves.
+// Each entry records the files the shader was compiled from (the module and everything it imports) along
+// with a hash of their contents, and is only used if all of them are still unchanged.
+class ShaderCache {
+public:
+    struct Key {
+        std::string module_name;
+        std::string entry_point;
+        // All entry points compiled together with this one, sorted. The binding stage flags are the union over
+        // the program, so the same entry point compiled as part of another program gives a different binary.
+        std::vector<std::string> program_entry_points;
+        std::string target_profile;
+        std::string compiler_version;
+        std::vector<std::string> search_paths;
+        std::vector<std::pair<std::string, std::string>> macros;
+    };
+
+    ShaderCache(const std::filesystem::path& cache_directory);
+    ~ShaderCache() = default;
+
+    std::optional<Shader::Binary> Load(const Key& key) const;
+
+    // Failing to store an entry isn't an error, the shader will just be compiled again next time.
+    void Store(const Key& key, const std::vector<std::string>& dependencies, const Shader::Binary& binary) const;
+
+private:
+    std::filesystem::path cache_directory_;
+
+    std::filesystem::path GetEntryPath(const std::string& serialized_key) const;
+};
\ No newline at end of file
@@ -21,6 +21,7 @@ public:
 
     std::shared_ptr<Image> GetImage(uint32_t image_index) const {return images_.at(image_index);}
     std::shared_ptr<ImageView> GetImageView(uint32_t image_index) const {return image_views_.at(image_index);}
+    uint32_t GetNumImages() const {return static_cast<uint32_t>(images_.size());}
 
 private:
     std::shared_ptr<Instance> instance_;
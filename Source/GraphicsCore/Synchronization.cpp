@@ -1,5 +1,7 @@
 #include "Synchronization.h"
 
+#include <algorithm>
+#include <cassert>
 #include <stdexcept>
 
 Fence::Fence(std::shared_ptr<Device> device, bool start_signaled) :
@@ -56,4 +58,69 @@ void Semaphore::CreateSemaphore() {
     if (vkCreateSemaphore(device_->GetLogicalDevice(), &semaphore_info, nullptr, &semaphore_) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create semaphore!");
     }
+}
+
+TimelineSemaphore::TimelineSemaphore(std::shared_ptr<Device> device, uint64_t initial_value) :
+    device_{ device },
+    semaphore_{ VK_NULL_HANDLE },
+    signal_value_{ initial_value }
+{
+    CreateSemaphore(initial_value);
+}
+
+TimelineSemaphore::~TimelineSemaphore() {
+    if (semaphore_ != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_->GetLogicalDevice(), semaphore_, nullptr);
+        semaphore_ = VK_NULL_HANDLE;
+    }
+}
+
+void TimelineSemaphore::Wait(uint64_t value, uint64_t ns) const {
+    VkSemaphoreWaitInfo wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &semaphore_,
+        .pValues = &value,
+    };
+
+    vkWaitSemaphores(device_->GetLogicalDevice(), &wait_info, ns);
+}
+
+void TimelineSemaphore::Signal(uint64_t value) {
+    assert(value > GetValue());
+
+    VkSemaphoreSignalInfo signal_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+        .semaphore = semaphore_,
+        .value = value,
+    };
+
+    if (vkSignalSemaphore(device_->GetLogicalDevice(), &signal_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to signal timeline semaphore!");
+    }
+
+    signal_value_ = std::max(signal_value_, value);
+}
+
+uint64_t TimelineSemaphore::GetValue() const {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device_->GetLogicalDevice(), semaphore_, &value);
+    return value;
+}
+
+void TimelineSemaphore::CreateSemaphore(uint64_t initial_value) {
+    VkSemaphoreTypeCreateInfo type_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = initial_value,
+    };
+
+    VkSemaphoreCreateInfo semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+    };
+
+    if (vkCreateSemaphore(device_->GetLogicalDevice(), &semaphore_info, nullptr, &semaphore_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore!");
+    }
 }
\ No newline at end of file
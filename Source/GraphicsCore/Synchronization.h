@@ -38,4 +38,34 @@ private:
     VkSemaphore semaphore_;
 
     void CreateSemaphore();
+};
+
+// A semaphore with a 64-bit counter instead of a signaled bit. Waiting for a value never resets the
+// counter, so any number of submissions and the host can wait on the same signal, and one timeline
+// per queue is enough to express every dependency on that queue's work.
+class TimelineSemaphore {
+public:
+    TimelineSemaphore(std::shared_ptr<Device> device, uint64_t initial_value = 0);
+    ~TimelineSemaphore();
+
+    void Wait(uint64_t value, uint64_t ns) const;
+    void Signal(uint64_t value);
+
+    // The value the semaphore currently has on the device.
+    uint64_t GetValue() const;
+
+    // Values have to increase monotonically, so the next signal value is handed out here.
+    // The last handed out value is the one that all pending signals will have reached.
+    inline uint64_t IncrementSignalValue() {return ++signal_value_;}
+    inline uint64_t GetSignalValue() const {return signal_value_;}
+
+    const VkSemaphore& GetSemaphore() const {return semaphore_;}
+
+private:
+    std::shared_ptr<Device> device_;
+
+    VkSemaphore semaphore_;
+    uint64_t signal_value_;
+
+    void CreateSemaphore(uint64_t initial_value);
 };
\ No newline at end of file
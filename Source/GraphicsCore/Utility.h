@@ -22,3 +22,36 @@ DEFINE_LOGGER_EXTERN(LogVulkan);
 extern PFN_vkCmdBeginRenderingKHR _vkCmdBeginRenderingKHR;
 extern PFN_vkCmdEndRenderingKHR _vkCmdEndRenderingKHR;
 
+// Only loaded if the device uses descriptor buffers.
+extern PFN_vkGetDescriptorSetLayoutSizeEXT _vkGetDescriptorSetLayoutSizeEXT;
+extern PFN_vkGetDescriptorSetLayoutBindingOffsetEXT _vkGetDescriptorSetLayoutBindingOffsetEXT;
+extern PFN_vkGetDescriptorEXT _vkGetDescriptorEXT;
+extern PFN_vkCmdBindDescriptorBuffersEXT _vkCmdBindDescriptorBuffersEXT;
+extern PFN_vkCmdSetDescriptorBufferOffsetsEXT _vkCmdSetDescriptorBufferOffsetsEXT;
+
+// Only loaded if the device uses shader objects.
+extern PFN_vkCreateShadersEXT _vkCreateShadersEXT;
+extern PFN_vkDestroyShaderEXT _vkDestroyShaderEXT;
+extern PFN_vkCmdBindShadersEXT _vkCmdBindShadersEXT;
+extern PFN_vkCmdSetViewportWithCountEXT _vkCmdSetViewportWithCountEXT;
+extern PFN_vkCmdSetScissorWithCountEXT _vkCmdSetScissorWithCountEXT;
+extern PFN_vkCmdSetVertexInputEXT _vkCmdSetVertexInputEXT;
+extern PFN_vkCmdSetPrimitiveTopologyEXT _vkCmdSetPrimitiveTopologyEXT;
+extern PFN_vkCmdSetPrimitiveRestartEnableEXT _vkCmdSetPrimitiveRestartEnableEXT;
+extern PFN_vkCmdSetRasterizerDiscardEnableEXT _vkCmdSetRasterizerDiscardEnableEXT;
+extern PFN_vkCmdSetPolygonModeEXT _vkCmdSetPolygonModeEXT;
+extern PFN_vkCmdSetCullModeEXT _vkCmdSetCullModeEXT;
+extern PFN_vkCmdSetFrontFaceEXT _vkCmdSetFrontFaceEXT;
+extern PFN_vkCmdSetDepthBiasEnableEXT _vkCmdSetDepthBiasEnableEXT;
+extern PFN_vkCmdSetRasterizationSamplesEXT _vkCmdSetRasterizationSamplesEXT;
+extern PFN_vkCmdSetSampleMaskEXT _vkCmdSetSampleMaskEXT;
+extern PFN_vkCmdSetAlphaToCoverageEnableEXT _vkCmdSetAlphaToCoverageEnableEXT;
+extern PFN_vkCmdSetDepthTestEnableEXT _vkCmdSetDepthTestEnableEXT;
+extern PFN_vkCmdSetDepthWriteEnableEXT _vkCmdSetDepthWriteEnableEXT;
+extern PFN_vkCmdSetDepthCompareOpEXT _vkCmdSetDepthCompareOpEXT;
+extern PFN_vkCmdSetDepthBoundsTestEnableEXT _vkCmdSetDepthBoundsTestEnableEXT;
+extern PFN_vkCmdSetStencilTestEnableEXT _vkCmdSetStencilTestEnableEXT;
+extern PFN_vkCmdSetColorBlendEnableEXT _vkCmdSetColorBlendEnableEXT;
+extern PFN_vkCmdSetColorBlendEquationEXT _vkCmdSetColorBlendEquationEXT;
+extern PFN_vkCmdSetColorWriteMaskEXT _vkCmdSetColorWriteMaskEXT;
+
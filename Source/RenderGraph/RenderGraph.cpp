@@ -0,0 +1,1026 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+
+#include "../GraphicsCore/DynamicState.h"
+#include "../GraphicsCore/Utility.h"
+
+DEFINE_LOGGER(LogRenderGraph, Logger::SeverityLevel::INFO);
+
+static VkPipelineStageFlags2 GetShaderStages(RenderGraph::PassType pass_type) {
+    switch (pass_type) {
+        case RenderGraph::PassType::GRAPHICS: {
+            return VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+        }
+        case RenderGraph::PassType::COMPUTE:
+        case RenderGraph::PassType::ASYNC_COMPUTE: {
+            return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        }
+        default: {
+            throw std::runtime_error("Transfer passes cannot access resources from shaders!");
+        }
+    }
+}
+
+static Device::QueueType GetQueueType(RenderGraph::PassType pass_type) {
+    return (pass_type == RenderGraph::PassType::ASYNC_COMPUTE) ? Device::QueueType::COMPUTE : Device::QueueType::GRAPHICS;
+}
+
+static ResourceState GetUsageState(RenderGraph::Usage usage, bool is_write, RenderGraph::PassType pass_type) {
+    switch (usage) {
+        case RenderGraph::Usage::VERTEX_BUFFER: {
+            return {VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+        case RenderGraph::Usage::INDEX_BUFFER: {
+            return {VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+        case RenderGraph::Usage::UNIFORM_BUFFER: {
+            return {GetShaderStages(pass_type), VK_ACCESS_2_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+        case RenderGraph::Usage::STORAGE_BUFFER: {
+            VkAccessFlags2 access = is_write ? VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+            return {GetShaderStages(pass_type), access, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+        case RenderGraph::Usage::SAMPLED_IMAGE: {
+            return {GetShaderStages(pass_type), VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        }
+        case RenderGraph::Usage::STORAGE_IMAGE: {
+            VkAccessFlags2 access = is_write ? VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+            return {GetShaderStages(pass_type), access, VK_IMAGE_LAYOUT_GENERAL};
+        }
+        case RenderGraph::Usage::COLOR_ATTACHMENT: {
+            VkAccessFlags2 access = is_write ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT;
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, access, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        }
+        case RenderGraph::Usage::DEPTH_ATTACHMENT: {
+            VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+            if (is_write) {
+                return {stages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL};
+            }
+            return {stages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL};
+        }
+        case RenderGraph::Usage::COPY: {
+            if (is_write) {
+                return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+            }
+            return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        }
+        case RenderGraph::Usage::PRESENT: {
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        }
+        case RenderGraph::Usage::HOST: {
+            VkAccessFlags2 access = is_write ? VK_ACCESS_2_HOST_WRITE_BIT : VK_ACCESS_2_HOST_READ_BIT;
+            return {VK_PIPELINE_STAGE_2_HOST_BIT, access, VK_IMAGE_LAYOUT_GENERAL};
+        }
+        default: {
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED};
+        }
+    }
+}
+
+static ResourceState GetUseState(RenderGraph::Usage usage, bool is_read, bool is_write, RenderGraph::PassType pass_type) {
+    if (!is_write) {
+        return GetUsageState(usage, false, pass_type);
+    }
+
+    // Resources that are read and written in the same pass need the accesses of both,
+    // so that earlier writes are made visible to the reads as well.
+    ResourceState state = GetUsageState(usage, true, pass_type);
+    if (is_read) {
+        ResourceState read_state = GetUsageState(usage, false, pass_type);
+        state.stage_flags |= read_state.stage_flags;
+        state.access_flags |= read_state.access_flags;
+    }
+    return state;
+}
+
+static bool IsConcurrent(const ResourceDesc& resource_desc) {
+    return resource_desc.sharing_mode == VK_SHARING_MODE_CONCURRENT && !resource_desc.queue_families.empty();
+}
+
+static bool IsAliasable(const ResourceDesc& resource_desc) {
+    // Only memory that lives on the GPU and is never touched by the host can be shared.
+    VmaAllocationCreateFlags host_access_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                                 VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                                                 VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    if ((resource_desc.allocation_flags & host_access_flags) != 0) {
+        return false;
+    }
+
+    return resource_desc.memory_usage == VMA_MEMORY_USAGE_AUTO ||
+           resource_desc.memory_usage == VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE ||
+           resource_desc.memory_usage == VMA_MEMORY_USAGE_GPU_ONLY;
+}
+
+static std::shared_ptr<ImageView> CreateDefaultImageView(std::shared_ptr<Device> device, std::shared_ptr<Image> image) {
+    VkComponentMapping default_mapping = {
+        .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+        .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+    };
+
+    VkImageSubresourceRange range = {
+        .aspectMask = image->GetAspectFlags(),
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    ImageView::Lens lens = {
+        .view_type = VK_IMAGE_VIEW_TYPE_2D,
+        .component_map = default_mapping,
+        .subresource_range = range,
+    };
+
+    return std::make_shared<ImageView>(device, image, lens);
+}
+
+static ResourceState GetInitialState(RenderGraph::Usage usage) {
+    if (usage == RenderGraph::Usage::PRESENT) {
+        // Images coming from the presentation engine are only synchronized by the acquire semaphore,
+        // which is waited on at the color attachment stage, so the first use has to chain with that.
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED};
+    }
+
+    return GetUsageState(usage, false, RenderGraph::PassType::GRAPHICS);
+}
+
+RenderGraph::Pass::Pass(const std::string& name, PassType type, std::function<void(CommandBuffer&)> callback) :
+    name_{ name },
+    type_{ type },
+    callback_{ callback },
+    is_culled_{ false }
+{}
+
+RenderGraph::Pass& RenderGraph::Pass::Read(BufferHandle buffer, Usage usage) {
+    AddUse(buffer.id, usage, false);
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Write(BufferHandle buffer, Usage usage) {
+    AddUse(buffer.id, usage, true);
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Read(ImageHandle image, Usage usage) {
+    AddUse(image.id, usage, false);
+    return *this;
+}
+
+RenderGraph::Pass& RenderGraph::Pass::Write(ImageHandle image, Usage usage) {
+    AddUse(image.id, usage, true);
+    return *this;
+}
+
+void RenderGraph::Pass::AddUse(uint32_t resource, Usage usage, bool is_write) {
+    // A resource that is both read and written in the same pass is tracked as a single use.
+    for (ResourceUse& use : uses_) {
+        if (use.resource == resource) {
+            assert(use.usage == usage);
+            use.is_read |= !is_write;
+            use.is_write |= is_write;
+            return;
+        }
+    }
+
+    uses_.push_back(ResourceUse{
+        .resource = resource,
+        .usage = usage,
+        .is_read = !is_write,
+        .is_write = is_write,
+    });
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<Device> device, Allocator& allocator, uint32_t num_frames_in_flight, ThreadPool* thread_pool) :
+    device_{ device },
+    allocator_{ allocator },
+    is_compiled_{ false },
+    thread_pool_{ thread_pool },
+    num_frames_in_flight_{ num_frames_in_flight },
+    frame_index_{ 0 },
+    transient_memory_size_{ 0 },
+    naive_transient_memory_size_{ 0 }
+{}
+
+RenderGraph::BufferHandle RenderGraph::CreateBuffer(const Buffer::Desc& buffer_desc) {
+    Resource resource = {
+        .type = ResourceType::BUFFER,
+        .is_imported = false,
+        .is_exported = false,
+        .initial_usage = Usage::NONE,
+        .final_usage = Usage::NONE,
+        .buffer_desc = buffer_desc,
+    };
+
+    resources_.push_back(resource);
+    is_compiled_ = false;
+    return BufferHandle{static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+RenderGraph::ImageHandle RenderGraph::CreateImage(const Image::Desc& image_desc) {
+    Resource resource = {
+        .type = ResourceType::IMAGE,
+        .is_imported = false,
+        .is_exported = false,
+        .initial_usage = Usage::NONE,
+        .final_usage = Usage::NONE,
+        .image_desc = image_desc,
+    };
+
+    resources_.push_back(resource);
+    is_compiled_ = false;
+    return ImageHandle{static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+RenderGraph::BufferHandle RenderGraph::ImportBuffer(std::shared_ptr<Buffer> buffer, Usage initial_usage) {
+    Resource resource = {
+        .type = ResourceType::BUFFER,
+        .is_imported = true,
+        .is_exported = false,
+        .initial_usage = initial_usage,
+        .final_usage = Usage::NONE,
+        .buffer = buffer,
+    };
+
+    resources_.push_back(resource);
+    is_compiled_ = false;
+    return BufferHandle{static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+RenderGraph::ImageHandle RenderGraph::ImportImage(std::shared_ptr<Image> image, std::shared_ptr<ImageView> image_view, Usage initial_usage) {
+    Resource resource = {
+        .type = ResourceType::IMAGE,
+        .is_imported = true,
+        .is_exported = false,
+        .initial_usage = initial_usage,
+        .final_usage = Usage::NONE,
+        .image_desc = image->GetImageDesc(),
+        .image = image,
+        .image_view = image_view,
+    };
+
+    resources_.push_back(resource);
+    is_compiled_ = false;
+    return ImageHandle{static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+void RenderGraph::RebindImportedBuffer(BufferHandle handle, std::shared_ptr<Buffer> buffer) {
+    Resource& resource = resources_.at(handle.id);
+    assert(resource.is_imported && resource.type == ResourceType::BUFFER);
+    resource.buffer = buffer;
+}
+
+void RenderGraph::RebindImportedImage(ImageHandle handle, std::shared_ptr<Image> image, std::shared_ptr<ImageView> image_view) {
+    Resource& resource = resources_.at(handle.id);
+    assert(resource.is_imported && resource.type == ResourceType::IMAGE);
+    resource.image = image;
+    resource.image_view = image_view;
+}
+
+void RenderGraph::ExportBuffer(BufferHandle handle, Usage final_usage) {
+    Resource& resource = resources_.at(handle.id);
+    assert(resource.type == ResourceType::BUFFER);
+    resource.is_exported = true;
+    resource.final_usage = final_usage;
+    is_compiled_ = false;
+}
+
+void RenderGraph::ExportImage(ImageHandle handle, Usage final_usage) {
+    Resource& resource = resources_.at(handle.id);
+    assert(resource.type == ResourceType::IMAGE);
+    resource.is_exported = true;
+    resource.final_usage = final_usage;
+    is_compiled_ = false;
+}
+
+RenderGraph::Pass& RenderGraph::AddPass(const std::string& name, PassType type, std::function<void(CommandBuffer&)> callback) {
+    is_compiled_ = false;
+    return passes_.emplace_back(name, type, callback);
+}
+
+void RenderGraph::Compile() {
+    BuildDependencies();
+    CullPasses();
+    SortPasses();
+    AllocateTransientResources();
+    BuildBatches();
+    BuildBarriers();
+    UseTransientCopies();
+
+    is_compiled_ = true;
+    LOG(LogRenderGraph, Logger::SeverityLevel::INFO, "Compiled render graph with {0} of {1} passes and {2} resources", schedule_.size(), passes_.size(), resources_.size());
+}
+
+void RenderGraph::Execute(CommandBuffer& command_buffer) {
+    assert(is_compiled_);
+    assert(batches_.size() == 1);
+    BeginFrame();
+    RecordBatch(command_buffer, 0);
+}
+
+void RenderGraph::Submit(Fence* fence) {
+    assert(is_compiled_);
+    BeginFrame();
+
+    // Each batch signals the next value on its queue's timeline, which later batches on the other queue wait for.
+    std::vector<uint64_t> signal_values(batches_.size(), 0);
+    for (uint32_t batch_index = 0; batch_index < batches_.size(); batch_index++) {
+        const Batch& batch = batches_[batch_index];
+        Device::QueueType queue_type = batch.queue_type;
+        if (command_rings_[queue_type] == nullptr) {
+            // Thread index 0 is the submitting thread, the workers of the thread pool come after it.
+            uint32_t num_threads = (thread_pool_ != nullptr) ? thread_pool_->GetNumThreads() + 1 : 1;
+            command_rings_[queue_type] = std::make_unique<CommandPoolRing>(device_, queue_type, num_frames_in_flight_, num_threads);
+            command_rings_[queue_type]->BeginFrame(frame_index_);
+            timelines_[queue_type] = std::make_unique<TimelineSemaphore>(device_);
+        }
+
+        CommandBuffer command_buffer = command_rings_[queue_type]->AllocateCommandBuffer();
+        command_buffer.Begin(true);
+        if (thread_pool_ != nullptr && batch.passes.size() > 1) {
+            RecordBatchParallel(command_buffer, *command_rings_[queue_type], batch_index);
+        } else {
+            RecordBatch(command_buffer, batch_index);
+        }
+        command_buffer.End();
+
+        for (uint32_t dependency : batch.dependencies) {
+            TimelineSemaphore& timeline = *timelines_[batches_[dependency].queue_type];
+            command_buffer.InsertWaitSemaphore(timeline, signal_values[dependency], batch.stage_flags);
+        }
+
+        signal_values[batch_index] = timelines_[queue_type]->IncrementSignalValue();
+        command_buffer.InsertSignalSemaphore(*timelines_[queue_type], signal_values[batch_index], VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+        bool is_first_batch = (batch_index == 0);
+        bool is_last_batch = (batch_index == batches_.size() - 1);
+        if (is_first_batch) {
+            for (const ExternalSemaphore& wait_semaphore : wait_semaphores_) {
+                command_buffer.InsertWaitSemaphore(*wait_semaphore.semaphore, wait_semaphore.stage_mask);
+            }
+        }
+
+        if (is_last_batch) {
+            for (const ExternalSemaphore& signal_semaphore : signal_semaphores_) {
+                command_buffer.InsertSignalSemaphore(*signal_semaphore.semaphore, signal_semaphore.stage_mask);
+            }
+        }
+
+        command_buffer.Submit(is_last_batch ? fence : nullptr);
+    }
+
+    wait_semaphores_.clear();
+    signal_semaphores_.clear();
+}
+
+void RenderGraph::BeginFrame() {
+    // The frame that used the same slot before is done by now, so all of its command buffers can be reset at once,
+    // and its transient resources reused.
+    frame_index_ = (frame_index_ + 1) % num_frames_in_flight_;
+    for (uint32_t queue_type = 0; queue_type < Device::QueueType::MAX_QUEUE_TYPES; queue_type++) {
+        if (command_rings_[queue_type] != nullptr) {
+            command_rings_[queue_type]->BeginFrame(frame_index_);
+        }
+    }
+
+    UseTransientCopies();
+}
+
+void RenderGraph::UseTransientCopies() {
+    for (Resource& resource : resources_) {
+        if (resource.transient_copies.empty()) {
+            continue;
+        }
+
+        const TransientCopy& transient_copy = resource.transient_copies[frame_index_];
+        resource.buffer = transient_copy.buffer;
+        resource.image = transient_copy.image;
+        resource.image_view = transient_copy.image_view;
+    }
+}
+
+void RenderGraph::InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask) {
+    wait_semaphores_.push_back(ExternalSemaphore{&semaphore, stage_mask});
+}
+
+void RenderGraph::InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask) {
+    signal_semaphores_.push_back(ExternalSemaphore{&semaphore, stage_mask});
+}
+
+std::shared_ptr<Buffer> RenderGraph::GetBuffer(BufferHandle handle) const {
+    const Resource& resource = resources_.at(handle.id);
+    assert(resource.type == ResourceType::BUFFER);
+    return resource.buffer;
+}
+
+std::shared_ptr<Image> RenderGraph::GetImage(ImageHandle handle) const {
+    const Resource& resource = resources_.at(handle.id);
+    assert(resource.type == ResourceType::IMAGE);
+    return resource.image;
+}
+
+std::shared_ptr<ImageView> RenderGraph::GetImageView(ImageHandle handle) const {
+    const Resource& resource = resources_.at(handle.id);
+    assert(resource.type == ResourceType::IMAGE);
+    return resource.image_view;
+}
+
+void RenderGraph::BuildDependencies() {
+    // Walk the passes in declaration order and connect every access to the accesses
+    // it has to wait for: reads wait on the last write, writes wait on the last write
+    // and on every read since then.
+    std::vector<int64_t> last_writers(resources_.size(), -1);
+    std::vector<std::vector<uint32_t>> readers(resources_.size());
+
+    auto add_dependency = [](Pass& pass, uint32_t dependency) {
+        for (uint32_t existing_dependency : pass.dependencies_) {
+            if (existing_dependency == dependency) {
+                return;
+            }
+        }
+        pass.dependencies_.push_back(dependency);
+    };
+
+    for (uint32_t pass_index = 0; pass_index < passes_.size(); pass_index++) {
+        Pass& pass = passes_[pass_index];
+        pass.dependencies_.clear();
+        pass.producers_.clear();
+
+        for (const Pass::ResourceUse& use : pass.uses_) {
+            // Writes also depend on the last writer, since they might only overwrite part of its output.
+            int64_t last_writer = last_writers[use.resource];
+            if (last_writer >= 0) {
+                add_dependency(pass, static_cast<uint32_t>(last_writer));
+                pass.producers_.push_back(static_cast<uint32_t>(last_writer));
+            }
+
+            if (use.is_write) {
+                for (uint32_t reader : readers[use.resource]) {
+                    if (reader != pass_index) {
+                        add_dependency(pass, reader);
+                    }
+                }
+
+                last_writers[use.resource] = pass_index;
+                readers[use.resource].clear();
+            } else {
+                readers[use.resource].push_back(pass_index);
+            }
+        }
+    }
+}
+
+void RenderGraph::CullPasses() {
+    // Start from the last writers of every exported resource and walk back through the passes
+    // they consume data from. Everything that isn't reached doesn't contribute to the output.
+    std::vector<uint32_t> live_passes;
+    std::vector<bool> is_exported_written(resources_.size(), false);
+    for (int64_t pass_index = static_cast<int64_t>(passes_.size()) - 1; pass_index >= 0; pass_index--) {
+        Pass& pass = passes_[pass_index];
+        pass.is_culled_ = true;
+
+        for (const Pass::ResourceUse& use : pass.uses_) {
+            if (use.is_write && resources_[use.resource].is_exported && !is_exported_written[use.resource]) {
+                is_exported_written[use.resource] = true;
+                if (pass.is_culled_) {
+                    pass.is_culled_ = false;
+                    live_passes.push_back(static_cast<uint32_t>(pass_index));
+                }
+            }
+        }
+    }
+
+    while (!live_passes.empty()) {
+        uint32_t pass_index = live_passes.back();
+        live_passes.pop_back();
+
+        for (uint32_t producer : passes_[pass_index].producers_) {
+            if (passes_[producer].is_culled_) {
+                passes_[producer].is_culled_ = false;
+                live_passes.push_back(producer);
+            }
+        }
+    }
+
+    uint32_t num_culled_passes = 0;
+    for (const Pass& pass : passes_) {
+        if (pass.is_culled_) {
+            LOG(LogRenderGraph, Logger::SeverityLevel::TRACE, "Culled pass {0}, it doesn't contribute to any exported resource", pass.name_);
+            num_culled_passes++;
+        }
+    }
+
+    if (num_culled_passes == passes_.size() && !passes_.empty()) {
+        LOG(LogRenderGraph, Logger::SeverityLevel::WARN, "All {0} passes were culled, did you forget to export the graph's outputs?", passes_.size());
+    }
+}
+
+void RenderGraph::SortPasses() {
+    // Culled passes are left out entirely, including the dependencies live passes have on them.
+    uint32_t num_live_passes = 0;
+    std::vector<uint32_t> num_dependencies(passes_.size(), 0);
+    std::vector<std::vector<uint32_t>> dependents(passes_.size());
+    for (uint32_t pass_index = 0; pass_index < passes_.size(); pass_index++) {
+        if (passes_[pass_index].is_culled_) {
+            continue;
+        }
+
+        num_live_passes++;
+        for (uint32_t dependency : passes_[pass_index].dependencies_) {
+            if (!passes_[dependency].is_culled_) {
+                dependents[dependency].push_back(pass_index);
+                num_dependencies[pass_index]++;
+            }
+        }
+    }
+
+    // Kahn's algorithm, always picking the earliest declared pass that is ready
+    // so that the schedule stays as close to the declaration order as possible.
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready_passes;
+    for (uint32_t pass_index = 0; pass_index < passes_.size(); pass_index++) {
+        if (!passes_[pass_index].is_culled_ && num_dependencies[pass_index] == 0) {
+            ready_passes.push(pass_index);
+        }
+    }
+
+    schedule_.clear();
+    while (!ready_passes.empty()) {
+        uint32_t pass_index = ready_passes.top();
+        ready_passes.pop();
+        schedule_.push_back(pass_index);
+
+        for (uint32_t dependent : dependents[pass_index]) {
+            if (--num_dependencies[dependent] == 0) {
+                ready_passes.push(dependent);
+            }
+        }
+    }
+
+    if (schedule_.size() != num_live_passes) {
+        throw std::runtime_error("Render graph contains a dependency cycle!");
+    }
+}
+
+void RenderGraph::AllocateTransientResources() {
+    // Find the part of the schedule each resource is alive in. Exported resources
+    // have to survive until the graph is done.
+    std::vector<uint32_t> first_uses(resources_.size(), UINT32_MAX);
+    std::vector<uint32_t> last_uses(resources_.size(), 0);
+    for (uint32_t schedule_index = 0; schedule_index < schedule_.size(); schedule_index++) {
+        for (const Pass::ResourceUse& use : passes_[schedule_[schedule_index]].uses_) {
+            first_uses[use.resource] = std::min(first_uses[use.resource], schedule_index);
+            last_uses[use.resource] = std::max(last_uses[use.resource], schedule_index);
+        }
+    }
+
+    std::vector<uint32_t> aliased_resources;
+    std::vector<VkMemoryRequirements> memory_requirements(resources_.size());
+    for (uint32_t resource_index = 0; resource_index < resources_.size(); resource_index++) {
+        Resource& resource = resources_[resource_index];
+        if (resource.is_imported) {
+            continue;
+        }
+
+        resource.buffer = nullptr;
+        resource.image = nullptr;
+        resource.image_view = nullptr;
+        resource.transient_copies.clear();
+        resource.previous_alias = -1;
+
+        if (resource.is_exported) {
+            last_uses[resource_index] = static_cast<uint32_t>(schedule_.size());
+        }
+
+        // Resources that are only used by culled passes don't need any memory at all.
+        bool is_used = first_uses[resource_index] != UINT32_MAX;
+        if (!is_used && !resource.is_exported) {
+            continue;
+        }
+
+        // Executions that are in flight at the same time never share memory, so the barriers of one execution
+        // don't have to wait on the previous one.
+        resource.transient_copies.resize(num_frames_in_flight_);
+
+        const ResourceDesc& resource_desc = (resource.type == ResourceType::BUFFER) ? resource.buffer_desc.resource_desc : resource.image_desc.resource_desc;
+        if (is_used && IsAliasable(resource_desc)) {
+            if (resource.type == ResourceType::BUFFER) {
+                memory_requirements[resource_index] = allocator_.GetBufferMemoryRequirements(resource.buffer_desc);
+            } else {
+                memory_requirements[resource_index] = allocator_.GetImageMemoryRequirements(resource.image_desc);
+            }
+            aliased_resources.push_back(resource_index);
+            continue;
+        }
+
+        for (TransientCopy& transient_copy : resource.transient_copies) {
+            if (resource.type == ResourceType::BUFFER) {
+                transient_copy.buffer = allocator_.AllocateBuffer(resource.buffer_desc);
+            } else {
+                transient_copy.image = allocator_.AllocateImage(resource.image_desc);
+                transient_copy.image_view = CreateDefaultImageView(device_, transient_copy.image);
+            }
+        }
+    }
+
+    // Greedily place resources into blocks in the order they come alive. A block can be reused as soon
+    // as everything in it is dead, and the block that wastes the least memory is picked. If none is big
+    // enough, the biggest one is grown instead of starting a new one.
+    std::sort(aliased_resources.begin(), aliased_resources.end(), [&](uint32_t a, uint32_t b) {
+        if (first_uses[a] != first_uses[b]) {
+            return first_uses[a] < first_uses[b];
+        }
+        return memory_requirements[a].size > memory_requirements[b].size;
+    });
+
+    struct AliasingBlock {
+        VkMemoryRequirements memory_requirements;
+        uint32_t last_use;
+        std::vector<uint32_t> resources;
+    };
+
+    std::vector<AliasingBlock> blocks;
+    naive_transient_memory_size_ = 0;
+    for (uint32_t resource_index : aliased_resources) {
+        const VkMemoryRequirements& requirements = memory_requirements[resource_index];
+        naive_transient_memory_size_ += requirements.size;
+
+        int64_t best_block = -1;
+        for (uint32_t block_index = 0; block_index < blocks.size(); block_index++) {
+            const AliasingBlock& block = blocks[block_index];
+            if (block.last_use >= first_uses[resource_index] || (block.memory_requirements.memoryTypeBits & requirements.memoryTypeBits) == 0) {
+                continue;
+            }
+
+            if (best_block < 0) {
+                best_block = block_index;
+                continue;
+            }
+
+            VkDeviceSize block_size = block.memory_requirements.size;
+            VkDeviceSize best_size = blocks[best_block].memory_requirements.size;
+            bool block_fits = block_size >= requirements.size;
+            bool best_fits = best_size >= requirements.size;
+            if ((block_fits && (!best_fits || block_size < best_size)) || (!block_fits && !best_fits && block_size > best_size)) {
+                best_block = block_index;
+            }
+        }
+
+        if (best_block < 0) {
+            blocks.push_back(AliasingBlock{
+                .memory_requirements = requirements,
+            });
+            best_block = static_cast<int64_t>(blocks.size() - 1);
+        } else {
+            AliasingBlock& block = blocks[best_block];
+            block.memory_requirements.size = std::max(block.memory_requirements.size, requirements.size);
+            block.memory_requirements.alignment = std::max(block.memory_requirements.alignment, requirements.alignment);
+            block.memory_requirements.memoryTypeBits &= requirements.memoryTypeBits;
+            resources_[resource_index].previous_alias = block.resources.back();
+        }
+
+        AliasingBlock& block = blocks[best_block];
+        block.last_use = last_uses[resource_index];
+        block.resources.push_back(resource_index);
+    }
+
+    // Every frame in flight gets the same blocks, and resources are placed into them the same way.
+    transient_memory_size_ = 0;
+    for (uint32_t frame_index = 0; frame_index < num_frames_in_flight_; frame_index++) {
+        for (const AliasingBlock& block : blocks) {
+            std::shared_ptr<MemoryBlock> memory_block = allocator_.AllocateMemoryBlock(block.memory_requirements);
+            if (frame_index == 0) {
+                transient_memory_size_ += memory_block->GetSize();
+            }
+
+            for (uint32_t resource_index : block.resources) {
+                Resource& resource = resources_[resource_index];
+                TransientCopy& transient_copy = resource.transient_copies[frame_index];
+                transient_copy.memory_block = memory_block;
+                if (resource.type == ResourceType::BUFFER) {
+                    transient_copy.buffer = allocator_.AllocateAliasingBuffer(resource.buffer_desc, memory_block);
+                } else {
+                    transient_copy.image = allocator_.AllocateAliasingImage(resource.image_desc, memory_block);
+                    transient_copy.image_view = CreateDefaultImageView(device_, transient_copy.image);
+                }
+            }
+        }
+    }
+
+    LOG(LogRenderGraph, Logger::SeverityLevel::INFO, "Aliased {0} transient resources into {1} memory blocks: {2} bytes instead of {3} bytes",
+        aliased_resources.size(), blocks.size(), transient_memory_size_, naive_transient_memory_size_);
+}
+
+void RenderGraph::BuildBatches() {
+    batches_.clear();
+
+    auto add_batch = [&](Device::QueueType queue_type) {
+        batches_.push_back(Batch{
+            .queue_type = queue_type,
+            .stage_flags = VK_PIPELINE_STAGE_2_NONE,
+        });
+    };
+
+    // The first and last batches are always on the graphics queue, since that's where imported
+    // resources come from and where exported resources are handed back.
+    add_batch(Device::QueueType::GRAPHICS);
+    for (uint32_t pass_index : schedule_) {
+        Pass& pass = passes_[pass_index];
+        Device::QueueType queue_type = GetQueueType(pass.type_);
+        if (batches_.back().queue_type != queue_type) {
+            add_batch(queue_type);
+        }
+
+        Batch& batch = batches_.back();
+        batch.passes.push_back(pass_index);
+        pass.batch_ = static_cast<uint32_t>(batches_.size() - 1);
+        for (const Pass::ResourceUse& use : pass.uses_) {
+            batch.stage_flags |= GetUseState(use.usage, use.is_read, use.is_write, pass.type_).stage_flags;
+        }
+    }
+
+    if (batches_.back().queue_type != Device::QueueType::GRAPHICS) {
+        add_batch(Device::QueueType::GRAPHICS);
+    }
+
+    // Waiting on a batch also covers everything submitted to its queue before it,
+    // so each batch only has to wait on the latest batch it depends on.
+    auto add_dependency = [&](uint32_t batch_index, uint32_t dependent_index) {
+        Batch& dependent = batches_[dependent_index];
+        if (batches_[batch_index].queue_type == dependent.queue_type) {
+            return;
+        }
+
+        for (uint32_t& dependency : dependent.dependencies) {
+            if (batches_[dependency].queue_type == batches_[batch_index].queue_type) {
+                dependency = std::max(dependency, batch_index);
+                return;
+            }
+        }
+
+        dependent.dependencies.push_back(batch_index);
+    };
+
+    // Besides the pass dependencies, a batch also has to wait on the last batch that used any of its
+    // resources on the other queue. That covers ownership transfers of resources that are only read,
+    // imported resources (which start out on the graphics queue) and memory reused by aliased resources.
+    // Transient resources start out unused, since earlier executions still in flight used other copies.
+    std::vector<int64_t> last_batches(resources_.size(), -1);
+    for (uint32_t resource_index = 0; resource_index < resources_.size(); resource_index++) {
+        if (resources_[resource_index].is_imported) {
+            last_batches[resource_index] = 0;
+        }
+    }
+
+    for (uint32_t batch_index = 0; batch_index < batches_.size(); batch_index++) {
+        for (uint32_t pass_index : batches_[batch_index].passes) {
+            const Pass& pass = passes_[pass_index];
+            for (uint32_t dependency : pass.dependencies_) {
+                if (!passes_[dependency].is_culled_) {
+                    add_dependency(passes_[dependency].batch_, batch_index);
+                }
+            }
+
+            for (const Pass::ResourceUse& use : pass.uses_) {
+                int64_t previous_alias = resources_[use.resource].previous_alias;
+                if (last_batches[use.resource] < 0 && previous_alias >= 0) {
+                    last_batches[use.resource] = last_batches[previous_alias];
+                }
+
+                if (last_batches[use.resource] >= 0) {
+                    add_dependency(static_cast<uint32_t>(last_batches[use.resource]), batch_index);
+                }
+                last_batches[use.resource] = batch_index;
+            }
+        }
+    }
+
+    uint32_t last_batch_index = static_cast<uint32_t>(batches_.size() - 1);
+    for (uint32_t resource_index = 0; resource_index < resources_.size(); resource_index++) {
+        if (resources_[resource_index].is_exported && last_batches[resource_index] >= 0) {
+            add_dependency(static_cast<uint32_t>(last_batches[resource_index]), last_batch_index);
+        }
+    }
+
+    uint32_t num_dependencies = 0;
+    for (Batch& batch : batches_) {
+        if (batch.stage_flags == VK_PIPELINE_STAGE_2_NONE) {
+            batch.stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+
+        num_dependencies += static_cast<uint32_t>(batch.dependencies.size());
+    }
+
+    if (batches_.size() > 1) {
+        LOG(LogRenderGraph, Logger::SeverityLevel::INFO, "Split render graph into {0} batches with {1} cross-queue dependencies", batches_.size(), num_dependencies);
+    }
+}
+
+void RenderGraph::BuildBarriers() {
+    // Buffers don't have layouts, so make sure the tracker never sees one. Resources that are shared
+    // between queue families don't need ownership transfers, so their queue family is never tracked either.
+    auto get_resource_state = [&](uint32_t resource_index, ResourceState state, Device::QueueType queue_type) {
+        const Resource& resource = resources_[resource_index];
+        if (resource.type == ResourceType::BUFFER) {
+            state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+
+        const ResourceDesc& resource_desc = (resource.type == ResourceType::BUFFER) ? resource.buffer_desc.resource_desc : resource.image_desc.resource_desc;
+        state.queue_family_index = IsConcurrent(resource_desc) ? VK_QUEUE_FAMILY_IGNORED : device_->GetQueue(queue_type).queue_family;
+        return state;
+    };
+
+    // Imported resources start out owned by the graphics queue. Transient resources don't have any contents
+    // worth keeping yet, so whichever queue uses them first can simply take them. No other execution in flight
+    // uses the same copy of them, so there's nothing to wait on either.
+    std::vector<ResourceStateTracker> trackers;
+    std::vector<bool> is_used(resources_.size(), false);
+    std::vector<int64_t> last_passes(resources_.size(), -1);
+    trackers.reserve(resources_.size());
+    for (uint32_t resource_index = 0; resource_index < resources_.size(); resource_index++) {
+        const Resource& resource = resources_[resource_index];
+        ResourceState initial_state = get_resource_state(resource_index, GetInitialState(resource.initial_usage), Device::QueueType::GRAPHICS);
+        if (!resource.is_imported) {
+            initial_state.queue_family_index = VK_QUEUE_FAMILY_IGNORED;
+        }
+        trackers.emplace_back(initial_state);
+    }
+
+    // Aliased resources start out with whatever the previous resource in the same memory did last,
+    // so that their first use waits for it. The contents are discarded either way.
+    auto begin_use = [&](uint32_t resource_index) {
+        if (is_used[resource_index]) {
+            return;
+        }
+        is_used[resource_index] = true;
+
+        int64_t previous_alias = resources_[resource_index].previous_alias;
+        if (previous_alias >= 0) {
+            ResourceState aliasing_state = trackers[previous_alias].GetLastAccess();
+            aliasing_state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            aliasing_state.queue_family_index = VK_QUEUE_FAMILY_IGNORED;
+            trackers[resource_index] = ResourceStateTracker{ aliasing_state };
+        }
+    };
+
+    // Only the uses that actually need to wait on something get a barrier, e.g. consecutive
+    // reads of a resource share the barrier recorded before the first one. Ownership transfers
+    // are split into a release after the last use on the old queue and an acquire on the new one.
+    auto add_barrier = [&](std::vector<Pass::Barrier>& barriers, uint32_t resource_index, const ResourceState& next_state) {
+        std::optional<ResourceStateTracker::Transition> transition = trackers[resource_index].TransitionTo(next_state);
+        if (!transition.has_value()) {
+            return;
+        }
+
+        if (transition->source.queue_family_index != transition->destination.queue_family_index) {
+            ResourceStateTracker::Transition release = *transition;
+            release.destination.stage_flags = VK_PIPELINE_STAGE_2_NONE;
+            release.destination.access_flags = VK_ACCESS_2_NONE;
+
+            int64_t last_pass = last_passes[resource_index];
+            std::vector<Pass::Barrier>& release_barriers = (last_pass >= 0) ? passes_[last_pass].release_barriers_ : initial_barriers_;
+            release_barriers.push_back(Pass::Barrier{
+                .resource = resource_index,
+                .transition = release,
+            });
+
+            // The acquire happens after the semaphore wait, which covers the stages of the new queue's batch.
+            transition->source.stage_flags = transition->destination.stage_flags;
+            transition->source.access_flags = VK_ACCESS_2_NONE;
+        }
+
+        barriers.push_back(Pass::Barrier{
+            .resource = resource_index,
+            .transition = *transition,
+        });
+    };
+
+    initial_barriers_.clear();
+    for (uint32_t pass_index : schedule_) {
+        passes_[pass_index].barriers_.clear();
+        passes_[pass_index].release_barriers_.clear();
+    }
+
+    for (uint32_t pass_index : schedule_) {
+        Pass& pass = passes_[pass_index];
+        Device::QueueType queue_type = GetQueueType(pass.type_);
+
+        for (const Pass::ResourceUse& use : pass.uses_) {
+            begin_use(use.resource);
+            ResourceState next_state = GetUseState(use.usage, use.is_read, use.is_write, pass.type_);
+            add_barrier(pass.barriers_, use.resource, get_resource_state(use.resource, next_state, queue_type));
+            last_passes[use.resource] = pass_index;
+        }
+    }
+
+    // Exported resources are handed back to the graphics queue, even if they don't need to change state otherwise.
+    final_barriers_.clear();
+    for (uint32_t resource_index = 0; resource_index < resources_.size(); resource_index++) {
+        const Resource& resource = resources_[resource_index];
+        if (!resource.is_exported) {
+            continue;
+        }
+
+        ResourceState final_state = {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, trackers[resource_index].GetLayout()};
+        if (resource.final_usage != Usage::NONE) {
+            final_state = GetUsageState(resource.final_usage, false, PassType::GRAPHICS);
+        }
+        add_barrier(final_barriers_, resource_index, get_resource_state(resource_index, final_state, Device::QueueType::GRAPHICS));
+    }
+}
+
+void RenderGraph::RecordBatch(CommandBuffer& command_buffer, uint32_t batch_index) {
+    if (batch_index == 0) {
+        InsertBarriers(command_buffer, initial_barriers_);
+    }
+
+    // Passes recorded into the same command buffer share its state, so state that stays the same from one pass
+    // to the next is only set once.
+    std::optional<DynamicStateTracker> dynamic_state;
+    if (device_->UsesShaderObjects()) {
+        dynamic_state.emplace(device_);
+        command_buffer.SetDynamicState(&*dynamic_state);
+    }
+
+    for (uint32_t pass_index : batches_[batch_index].passes) {
+        RecordPass(command_buffer, passes_[pass_index]);
+    }
+    command_buffer.SetDynamicState(nullptr);
+
+    if (batch_index == batches_.size() - 1) {
+        InsertBarriers(command_buffer, final_barriers_);
+    }
+}
+
+void RenderGraph::RecordBatchParallel(CommandBuffer& command_buffer, CommandPoolRing& command_ring, uint32_t batch_index) {
+    const Batch& batch = batches_[batch_index];
+
+    // Every pass gets its own secondary command buffer from the pool of the worker recording it,
+    // and executing them in schedule order gives the same result as recording them one after another.
+    std::vector<VkCommandBuffer> secondary_command_buffers(batch.passes.size(), VK_NULL_HANDLE);
+    thread_pool_->ParallelFor(static_cast<uint32_t>(batch.passes.size()), [&](uint32_t index, uint32_t thread_index) {
+        CommandBuffer secondary_command_buffer = command_ring.AllocateCommandBuffer(thread_index + 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        secondary_command_buffer.BeginSecondary(true);
+
+        // Secondary command buffers don't inherit any state, so each one starts with a tracker of its own.
+        std::optional<DynamicStateTracker> dynamic_state;
+        if (device_->UsesShaderObjects()) {
+            dynamic_state.emplace(device_);
+            secondary_command_buffer.SetDynamicState(&*dynamic_state);
+        }
+
+        RecordPass(secondary_command_buffer, passes_[batch.passes[index]]);
+        secondary_command_buffer.End();
+        secondary_command_buffers[index] = secondary_command_buffer.GetCommandBuffer();
+    });
+
+    if (batch_index == 0) {
+        InsertBarriers(command_buffer, initial_barriers_);
+    }
+
+    command_buffer.ExecuteCommands(secondary_command_buffers);
+
+    if (batch_index == batches_.size() - 1) {
+        InsertBarriers(command_buffer, final_barriers_);
+    }
+}
+
+void RenderGraph::RecordPass(CommandBuffer& command_buffer, Pass& pass) {
+    InsertBarriers(command_buffer, pass.barriers_);
+    pass.callback_(command_buffer);
+    InsertBarriers(command_buffer, pass.release_barriers_);
+}
+
+void RenderGraph::InsertBarriers(CommandBuffer& command_buffer, const std::vector<Pass::Barrier>& barriers) const {
+    if (barriers.empty()) {
+        return;
+    }
+
+    ResourceBarrier resource_barrier;
+    for (const Pass::Barrier& barrier : barriers) {
+        const Resource& resource = resources_[barrier.resource];
+        if (resource.type == ResourceType::BUFFER) {
+            resource_barrier.AddBufferMemoryBarrier(barrier.transition.source, barrier.transition.destination, *resource.buffer);
+        } else {
+            VkImageSubresourceRange range = {
+                .aspectMask = resource.image->GetAspectFlags(),
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS,
+            };
+
+            resource_barrier.AddImageMemoryBarrier(barrier.transition.source, barrier.transition.destination,
+                                                   barrier.transition.old_layout, barrier.transition.new_layout,
+                                                   *resource.image, range);
+        }
+    }
+
+    resource_barrier.InsertIntoCommandBuffer(command_buffer);
+}
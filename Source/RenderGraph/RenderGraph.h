@@ -0,0 +1,244 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "../CoreUtility/ThreadPool.h"
+#include "../GraphicsCore/Command.h"
+#include "../GraphicsCore/Device.h"
+#include "../GraphicsCore/Resources.h"
+#include "../GraphicsCore/ResourceState.h"
+#include "../GraphicsCore/Synchronization.h"
+
+class RenderGraph {
+public:
+    // Async compute passes run on the device's compute queue, overlapping with the passes on the
+    // graphics queue. Everything else, including regular compute passes, runs on the graphics queue.
+    enum PassType {
+        GRAPHICS,
+        COMPUTE,
+        ASYNC_COMPUTE,
+        TRANSFER,
+    };
+
+    // How a pass uses a resource. Combined with the pass type and whether the
+    // access is a read or a write, this determines the pipeline stages,
+    // access masks and image layout used when building barriers.
+    enum Usage {
+        NONE,
+        VERTEX_BUFFER,
+        INDEX_BUFFER,
+        UNIFORM_BUFFER,
+        STORAGE_BUFFER,
+        SAMPLED_IMAGE,
+        STORAGE_IMAGE,
+        COLOR_ATTACHMENT,
+        DEPTH_ATTACHMENT,
+        COPY,
+        PRESENT,
+        HOST,
+    };
+
+    struct BufferHandle {
+        uint32_t id;
+    };
+
+    struct ImageHandle {
+        uint32_t id;
+    };
+
+    class Pass {
+    public:
+        friend class RenderGraph;
+
+        Pass(const std::string& name, PassType type, std::function<void(CommandBuffer&)> callback);
+
+        Pass& Read(BufferHandle buffer, Usage usage);
+        Pass& Write(BufferHandle buffer, Usage usage);
+        Pass& Read(ImageHandle image, Usage usage);
+        Pass& Write(ImageHandle image, Usage usage);
+
+        inline const std::string& GetName() const {return name_;}
+        inline PassType GetType() const {return type_;}
+        inline bool IsCulled() const {return is_culled_;}
+
+    private:
+        struct ResourceUse {
+            uint32_t resource;
+            Usage usage;
+            bool is_read;
+            bool is_write;
+        };
+
+        struct Barrier {
+            uint32_t resource;
+            ResourceStateTracker::Transition transition;
+        };
+
+        std::string name_;
+        PassType type_;
+        std::function<void(CommandBuffer&)> callback_;
+
+        std::vector<ResourceUse> uses_;
+
+        // Filled in by RenderGraph::Compile(). Producers are the passes whose writes this pass
+        // actually consumes, as opposed to dependencies that only exist to avoid overwriting data.
+        // Release barriers hand resources over to the other queue after the pass is done with them.
+        std::vector<uint32_t> dependencies_;
+        std::vector<uint32_t> producers_;
+        bool is_culled_;
+        uint32_t batch_;
+        std::vector<Barrier> release_barriers_;
+        std::vector<Barrier> barriers_;
+
+        void AddUse(uint32_t resource, Usage usage, bool is_write);
+    };
+
+    // The number of frames in flight is how many submits of the graph can be executing at once,
+    // which determines how long the command buffers used by Submit() are kept around. Every frame in flight
+    // also gets its own copy of the transient resources, so executions never wait on each other.
+    // With a thread pool, Submit() records the passes of a batch in parallel, each into its own secondary
+    // command buffer, so pass callbacks have to be safe to call at the same time as each other.
+    // On a device that uses shader objects, pass callbacks bind shaders and state through the command buffer's
+    // DynamicStateTracker (see CommandBuffer::GetDynamicState()), which is shared by all passes recorded into it.
+    RenderGraph(std::shared_ptr<Device> device, Allocator& allocator, uint32_t num_frames_in_flight = 1, ThreadPool* thread_pool = nullptr);
+    ~RenderGraph() = default;
+
+    // Transient resources are owned by the graph and only allocated during Compile().
+    BufferHandle CreateBuffer(const Buffer::Desc& buffer_desc);
+    ImageHandle CreateImage(const Image::Desc& image_desc);
+
+    // Imported resources are owned externally. The usage describes the state the resource
+    // is in when the graph starts executing, and may be rebound between executions
+    // as long as the new resource is in the same state (e.g. the next swapchain image).
+    BufferHandle ImportBuffer(std::shared_ptr<Buffer> buffer, Usage initial_usage = Usage::NONE);
+    ImageHandle ImportImage(std::shared_ptr<Image> image, std::shared_ptr<ImageView> image_view, Usage initial_usage = Usage::NONE);
+    void RebindImportedBuffer(BufferHandle handle, std::shared_ptr<Buffer> buffer);
+    void RebindImportedImage(ImageHandle handle, std::shared_ptr<Image> image, std::shared_ptr<ImageView> image_view);
+
+    // Exported resources are transitioned into the given usage once all passes have executed.
+    // They are also the outputs of the graph: passes that don't contribute to any of them are culled.
+    void ExportBuffer(BufferHandle handle, Usage final_usage);
+    void ExportImage(ImageHandle handle, Usage final_usage);
+
+    Pass& AddPass(const std::string& name, PassType type, std::function<void(CommandBuffer&)> callback);
+
+    // Compiling (re)allocates all transient resources, so it must not happen while
+    // a previous execution of the graph is still in flight.
+    void Compile();
+
+    // Records the whole graph into the given command buffer. Only possible if there are no async compute passes.
+    // Like Submit(), this moves on to the transient resources of the next frame in flight.
+    void Execute(CommandBuffer& command_buffer);
+
+    // Records the graph into command buffers owned by the graph and submits them, split into batches wherever
+    // the work moves between the graphics and compute queues. The semaphores are waited on before the first
+    // graphics batch and signaled after the last one, and only apply to the next submit.
+    void Submit(Fence* fence = nullptr);
+    void InsertWaitSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask);
+    void InsertSignalSemaphore(Semaphore& semaphore, VkPipelineStageFlags2 stage_mask);
+
+    // Transient resources are the copies of the current execution, so they have to be asked for again every frame.
+    std::shared_ptr<Buffer> GetBuffer(BufferHandle handle) const;
+    std::shared_ptr<Image> GetImage(ImageHandle handle) const;
+    std::shared_ptr<ImageView> GetImageView(ImageHandle handle) const;
+
+    inline const std::vector<uint32_t>& GetSchedule() const {return schedule_;}
+    inline const Pass& GetPass(uint32_t pass_index) const {return passes_.at(pass_index);}
+
+    // Memory used by the aliased transient resources of a single frame in flight, and what they would use without aliasing.
+    inline VkDeviceSize GetTransientMemorySize() const {return transient_memory_size_;}
+    inline VkDeviceSize GetNaiveTransientMemorySize() const {return naive_transient_memory_size_;}
+
+private:
+    enum ResourceType {
+        BUFFER,
+        IMAGE,
+    };
+
+    // The memory of a transient resource that belongs to one frame in flight.
+    struct TransientCopy {
+        std::shared_ptr<Buffer> buffer;
+        std::shared_ptr<Image> image;
+        std::shared_ptr<ImageView> image_view;
+        std::shared_ptr<MemoryBlock> memory_block;
+    };
+
+    struct Resource {
+        ResourceType type;
+        bool is_imported;
+        bool is_exported;
+        Usage initial_usage;
+        Usage final_usage;
+
+        Buffer::Desc buffer_desc;
+        Image::Desc image_desc;
+
+        // What the current execution uses. For transient resources, that is the copy of the current frame in flight.
+        std::shared_ptr<Buffer> buffer;
+        std::shared_ptr<Image> image;
+        std::shared_ptr<ImageView> image_view;
+        std::vector<TransientCopy> transient_copies;
+
+        // Transient resources sharing memory with others. The previous alias is the resource that used the
+        // memory before this one, which has to be waited on. Aliasing is the same for every frame in flight.
+        int64_t previous_alias = -1;
+    };
+
+    // A run of consecutive scheduled passes on the same queue, submitted together. Every batch signals
+    // its queue's timeline when done, and waits on the last batch of the other queue it depends on.
+    struct Batch {
+        Device::QueueType queue_type;
+        std::vector<uint32_t> passes;
+        VkPipelineStageFlags2 stage_flags;
+        std::vector<uint32_t> dependencies;
+    };
+
+    struct ExternalSemaphore {
+        Semaphore* semaphore;
+        VkPipelineStageFlags2 stage_mask;
+    };
+
+    std::shared_ptr<Device> device_;
+    Allocator& allocator_;
+
+    std::deque<Pass> passes_;
+    std::vector<Resource> resources_;
+
+    bool is_compiled_;
+    std::vector<uint32_t> schedule_;
+    std::vector<Pass::Barrier> initial_barriers_;
+    std::vector<Pass::Barrier> final_barriers_;
+    std::vector<Batch> batches_;
+
+    ThreadPool* thread_pool_;
+    uint32_t num_frames_in_flight_;
+    uint32_t frame_index_;
+    std::unique_ptr<CommandPoolRing> command_rings_[Device::QueueType::MAX_QUEUE_TYPES];
+    std::unique_ptr<TimelineSemaphore> timelines_[Device::QueueType::MAX_QUEUE_TYPES];
+    std::vector<ExternalSemaphore> wait_semaphores_;
+    std::vector<ExternalSemaphore> signal_semaphores_;
+
+    VkDeviceSize transient_memory_size_;
+    VkDeviceSize naive_transient_memory_size_;
+
+    void BuildDependencies();
+    void CullPasses();
+    void SortPasses();
+    void AllocateTransientResources();
+    void BuildBatches();
+    void BuildBarriers();
+
+    void BeginFrame();
+    void UseTransientCopies();
+
+    void RecordBatch(CommandBuffer& command_buffer, uint32_t batch_index);
+    void RecordBatchParallel(CommandBuffer& command_buffer, CommandPoolRing& command_ring, uint32_t batch_index);
+    void RecordPass(CommandBuffer& command_buffer, Pass& pass);
+    void InsertBarriers(CommandBuffer& command_buffer, const std::vector<Pass::Barrier>& barriers) const;
+};
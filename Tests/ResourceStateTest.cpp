@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+
+#include "GraphicsCore/ResourceState.h"
+
+// Checks the barriers ResourceStateTracker derives for known sequences of uses. No device is needed,
+// the tracker only computes stage, access and layout masks.
+static uint32_t num_failures = 0;
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            num_failures++;                                                                 \
+        }                                                                                   \
+    } while (0)
+
+using Transition = ResourceStateTracker::Transition;
+
+static bool IsAccess(const ResourceBarrier::AccessInfo& access, VkPipelineStageFlags2 stage_flags, VkAccessFlags2 access_flags) {
+    return access.stage_flags == stage_flags && access.access_flags == access_flags;
+}
+
+static const ResourceState COMPUTE_WRITE = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+static const ResourceState VERTEX_READ = {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+static const ResourceState FRAGMENT_READ = {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+static const ResourceState TRANSFER_WRITE = {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+
+static void TestReadAfterWrite() {
+    ResourceStateTracker tracker;
+
+    // Nothing used the buffer before, so there is nothing to wait for.
+    CHECK(!tracker.TransitionTo(COMPUTE_WRITE).has_value());
+
+    std::optional<Transition> transition = tracker.TransitionTo(FRAGMENT_READ);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+        CHECK(transition->source.queue_family_index == VK_QUEUE_FAMILY_IGNORED);
+    }
+}
+
+static void TestReadAfterReadMerge() {
+    ResourceStateTracker tracker;
+    tracker.TransitionTo(COMPUTE_WRITE);
+    tracker.TransitionTo(FRAGMENT_READ);
+
+    // The write is already visible to fragment shader reads.
+    CHECK(!tracker.TransitionTo(FRAGMENT_READ).has_value());
+
+    // A read in another stage only waits on the write for that stage.
+    std::optional<Transition> transition = tracker.TransitionTo(VERTEX_READ);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+    }
+
+    CHECK(!tracker.TransitionTo(VERTEX_READ).has_value());
+    CHECK(!tracker.TransitionTo(FRAGMENT_READ).has_value());
+}
+
+static void TestWriteAfterRead() {
+    ResourceStateTracker tracker;
+    tracker.TransitionTo(COMPUTE_WRITE);
+    tracker.TransitionTo(FRAGMENT_READ);
+    tracker.TransitionTo(VERTEX_READ);
+
+    // The reads already waited on the earlier write, so only an execution dependency on them is needed.
+    std::optional<Transition> transition = tracker.TransitionTo(TRANSFER_WRITE);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_NONE));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT));
+    }
+
+    // Write after write has to make the first write available.
+    transition = tracker.TransitionTo(COMPUTE_WRITE);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+    }
+}
+
+static void TestLayoutChange() {
+    ResourceStateTracker tracker;
+
+    // Even the first use needs a barrier, for the layout transition.
+    ResourceState color_write = ResourceState::FromLayout(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    std::optional<Transition> transition = tracker.TransitionTo(color_write);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(transition->old_layout == VK_IMAGE_LAYOUT_UNDEFINED);
+        CHECK(transition->new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        CHECK(transition->source.stage_flags == VK_PIPELINE_STAGE_2_NONE);
+    }
+
+    ResourceState sampled_read = {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    transition = tracker.TransitionTo(sampled_read);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT));
+        CHECK(transition->old_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        CHECK(transition->new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    CHECK(tracker.GetLayout() == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Reading again in the same layout doesn't need another transition.
+    CHECK(!tracker.TransitionTo(sampled_read).has_value());
+}
+
+static void TestQueueFamilyTransfer() {
+    ResourceStateTracker tracker{ {.queue_family_index = 0} };
+
+    ResourceState compute_write = COMPUTE_WRITE;
+    compute_write.queue_family_index = 0;
+    CHECK(!tracker.TransitionTo(compute_write).has_value());
+
+    ResourceState fragment_read = FRAGMENT_READ;
+    fragment_read.queue_family_index = 1;
+    std::optional<Transition> transition = tracker.TransitionTo(fragment_read);
+    CHECK(transition.has_value());
+    if (transition) {
+        CHECK(IsAccess(transition->source, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+        CHECK(IsAccess(transition->destination, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT));
+        CHECK(transition->source.queue_family_index == 0);
+        CHECK(transition->destination.queue_family_index == 1);
+    }
+    CHECK(tracker.GetQueueFamily() == 1);
+
+    // Uses that don't care about the queue family don't transfer it back.
+    CHECK(!tracker.TransitionTo(FRAGMENT_READ).has_value());
+    CHECK(tracker.GetQueueFamily() == 1);
+}
+
+int main() {
+    TestReadAfterWrite();
+    TestReadAfterReadMerge();
+    TestWriteAfterRead();
+    TestLayoutChange();
+    TestQueueFamilyTransfer();
+
+    if (num_failures > 0) {
+        std::cerr << num_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}